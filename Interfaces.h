@@ -13,7 +13,9 @@
 // Machines
 // Scheduler
 // Tasks
+// Traces (replay of recorded tasks)
 // VM (virtual machines)
+// What-if forks, see WhatIf.hpp
 
 #include <string>
 #include <stdexcept>
@@ -26,6 +28,17 @@ extern void             ThrowException(string err_msg);
 extern void             ThrowException(string err_msg, string further_input);
 extern void             ThrowException(string err_msg, unsigned further_input);
 
+// Messages with a level above SIM_MAX_VERBOSITY are compiled out. SIM_OUTPUT only builds its
+// message when the level survives that cut, so a filtered message costs no string formatting.
+#ifndef SIM_MAX_VERBOSITY
+#define SIM_MAX_VERBOSITY 4
+#endif
+#define SIM_OUTPUT(msg, verbose_level)                                  \
+    do {                                                                \
+        if((verbose_level) <= SIM_MAX_VERBOSITY)                        \
+            SimOutput((msg), (verbose_level));                          \
+    } while(0)
+
 // Machine Interface
 extern CPUType_t        Machine_GetCPUType(MachineId_t machine_id);
 extern uint64_t         Machine_GetEnergy(MachineId_t machine_id);
@@ -38,11 +51,13 @@ extern void             Machine_SetState(MachineId_t machine_id, MachineState_t
 // Scheduler Interface
 extern void             InitScheduler();                                    // Called once at the beginning
 extern void             HandleNewTask(Time_t time, TaskId_t task_id);       // Called every time a new task arrives to the system
+extern void             HandleNewTasks(Time_t time, const TaskId_t * task_ids, size_t count);   // Called with the arrivals of a batch, when arrival batching is on
 extern void             HandleTaskCompletion(Time_t time, TaskId_t task_id);// Called whenver a task finishes
 extern void             MemoryWarning(Time_t time, MachineId_t machine_id); // Called to alert the scheduler of memory overcommitment
 extern void             MigrationDone(Time_t time, VMId_t vm_id);           // Called to alert the scheduler that the VM has been migrated successfully
 extern void             SchedulerCheck(Time_t time);                        // Called periodically. You may want to do some monitoring and adjustments
 extern void             SimulationComplete(Time_t time);                    // Called at the end of the simulation
+extern void             SLARisk(Time_t time, TaskId_t task_id);             // Called from SchedulerCheck() when a task is projected to miss or barely make its SLA
 extern void             SLAWarning(Time_t time, TaskId_t task_id);          // Called to alert the schedule of an SLA violation
 extern void             StateChangeComplete(Time_t time, MachineId_t machine_id);   // Called in response to an earlier request to change the state of a machine
 
@@ -52,6 +67,11 @@ extern double           GetSLAReport(SLAType_t sla);
 // Simulator Interface
 extern Time_t           Now();
 
+// Trace Interface
+extern void             Trace_Open(string filename, unsigned lookahead);    // Replays a recorded task trace, see Trace.cpp for the format
+extern void             Trace_Reopen();                                     // Called in a forked process to read the trace independently
+extern void             Trace_TaskArrived(Time_t time, TaskId_t task_id);   // Reads ahead in the trace, called on every task arrival
+
 // Task Interface
 extern unsigned         GetNumTasks();
 extern TaskInfo_t       GetTaskInfo(TaskId_t task_id);
@@ -0,0 +1,164 @@
+//
+//  Metrics.cpp
+//  CloudSim
+//
+//  Time series of the cluster state, written as CSV on a background thread.
+//
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+#include "Metrics.hpp"
+
+#define METRICS_FILES   2
+#define METRICS_FLUSH   (1 << 16)           // Bytes buffered per file before they go to the writer
+
+bool metrics_enabled = false;
+
+static const char * file_suffixes[METRICS_FILES] = { ".machines.csv", ".cluster.csv" };
+static FILE * files[METRICS_FILES];
+static string buffers[METRICS_FILES];
+static Time_t interval = 1000000;
+static Time_t next_sample = 0;
+static vector<uint64_t> last_energy;        // Per machine, at the previous sample
+static Time_t last_machine_sample = 0;
+static double last_cluster_energy = 0;
+static Time_t last_cluster_sample = 0;
+
+// Writer thread and the buffers waiting for it. An exit() that skips Metrics_Close(), e.g. on an
+// exception in the simulator, leaves the writer waiting. Static destructors would then run under
+// it: a joinable std::thread terminates the process and a condition variable with a waiter can
+// hang the exit. So the thread and everything it uses are allocated once and never destroyed.
+static thread * writer = nullptr;
+static mutex & queue_lock = * new mutex;
+static condition_variable & queue_ready = * new condition_variable;
+static vector<pair<unsigned, string>> & pending = * new vector<pair<unsigned, string>>;
+static bool stopping = false;
+
+static void WriterLoop() {
+    vector<pair<unsigned, string>> batch;
+    unique_lock<mutex> lock(queue_lock);
+    for(;;) {
+        queue_ready.wait(lock, []() { return stopping || !pending.empty(); });
+        batch.swap(pending);
+        bool done = stopping;
+        lock.unlock();
+        for(auto & block : batch)
+            fwrite(block.second.data(), 1, block.second.size(), files[block.first]);
+        batch.clear();
+        lock.lock();
+        if(done && pending.empty())
+            return;
+    }
+}
+
+static void Submit(unsigned file) {
+    string block;
+    block.swap(buffers[file]);
+    buffers[file].reserve(METRICS_FLUSH + 256);
+    {
+        lock_guard<mutex> lock(queue_lock);
+        pending.emplace_back(file, move(block));
+    }
+    queue_ready.notify_one();
+}
+
+static void Append(unsigned file, const char * row, int length) {
+    if(length <= 0)
+        return;
+    buffers[file].append(row, size_t(length));
+    if(buffers[file].size() >= METRICS_FLUSH)
+        Submit(file);
+}
+
+void Metrics_Init() {
+    const char * base = getenv("CLOUDSIM_METRICS");
+    if(!base)
+        return;
+    const char * setting = getenv("CLOUDSIM_METRICS_INTERVAL");
+    if(setting && strtoull(setting, nullptr, 10) > 0)
+        interval = strtoull(setting, nullptr, 10);
+    for(unsigned i = 0; i < METRICS_FILES; i++) {
+        string name = string(base) + file_suffixes[i];
+        files[i] = fopen(name.c_str(), "w");
+        if(!files[i])
+            ThrowException("Metrics_Init(): Cannot write ", name);
+        buffers[i].reserve(METRICS_FLUSH + 256);
+    }
+    buffers[0] = "time,machine,s_state,p_state,power_w,utilization,memory_used,active_tasks\n";
+    buffers[1] = "time,power_w,energy_kwh,tasks_in_flight";
+    for(unsigned i = 0; i < NUM_SLAS; i++) {
+        string sla = "sla" + to_string(i);
+        buffers[1] += "," + sla + "_completed," + sla + "_violated," + sla + "_in_flight," + sla + "_late";
+    }
+    buffers[1] += "\n";
+    writer = new thread(WriterLoop);
+    metrics_enabled = true;
+    SIM_OUTPUT("Metrics_Init(): Writing " + string(base) + ".*.csv every " + to_string(interval) + " us", 1);
+}
+
+bool Metrics_Due(Time_t now) {
+    if(!metrics_enabled || now < next_sample)
+        return false;
+    next_sample = now + interval;
+    return true;
+}
+
+void Metrics_Machine(Time_t time, MachineId_t machine_id, MachineState_t s_state, CPUPerformance_t p_state,
+                     uint64_t energy, double utilization, unsigned memory_used, unsigned active_tasks) {
+    if(machine_id >= last_energy.size())
+        last_energy.resize(machine_id + 1, 0);
+    // Energy is in uJ and time in us, so the ratio is in W
+    Time_t elapsed = time > last_machine_sample ? time - last_machine_sample : 0;
+    double power = elapsed ? double(energy - last_energy[machine_id]) / double(elapsed) : 0;
+    last_energy[machine_id] = energy;
+    char row[160];
+    int length = snprintf(row, sizeof(row), "%lu,%u,%d,%d,%.3f,%.3f,%u,%u\n", (unsigned long) time, machine_id,
+                          int(s_state), int(p_state), power, utilization, memory_used, active_tasks);
+    Append(0, row, length);
+}
+
+void Metrics_Cluster(Time_t time, double energy_kwh, const SLACounts_t * sla) {
+    Time_t elapsed = time > last_cluster_sample ? time - last_cluster_sample : 0;
+    // 1 KW-Hour is 3.6e12 uJ
+    double power = elapsed ? (energy_kwh - last_cluster_energy) * 3.6e12 / double(elapsed) : 0;
+    last_cluster_energy = energy_kwh;
+    last_cluster_sample = last_machine_sample = time;
+    unsigned in_flight = 0;
+    for(unsigned i = 0; i < NUM_SLAS; i++)
+        in_flight += sla[i].in_flight;
+    char row[512];
+    int length = snprintf(row, sizeof(row), "%lu,%.3f,%.9f,%u", (unsigned long) time, power, energy_kwh, in_flight);
+    for(unsigned i = 0; i < NUM_SLAS && length > 0 && size_t(length) < sizeof(row); i++)
+        length += snprintf(row + length, sizeof(row) - size_t(length), ",%u,%u,%u,%u",
+                           sla[i].completed, sla[i].violated, sla[i].in_flight, sla[i].late);
+    if(length > 0 && size_t(length) < sizeof(row) - 1) {
+        row[length++] = '\n';
+        Append(1, row, length);
+    }
+}
+
+void Metrics_Close() {
+    if(!metrics_enabled)
+        return;
+    metrics_enabled = false;
+    for(unsigned i = 0; i < METRICS_FILES; i++)
+        if(!buffers[i].empty())
+            Submit(i);
+    {
+        lock_guard<mutex> lock(queue_lock);
+        stopping = true;
+    }
+    queue_ready.notify_one();
+    writer->join();
+    for(unsigned i = 0; i < METRICS_FILES; i++)
+        fclose(files[i]);
+}
+
+void Metrics_Detach() {
+    // Only the forking thread exists in the fork and the writer lock may be held, leave both alone
+    metrics_enabled = false;
+}
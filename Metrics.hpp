@@ -0,0 +1,31 @@
+//
+//  Metrics.hpp
+//  CloudSim
+//
+//  Time series of the cluster state, written as CSV on a background thread.
+//
+
+#ifndef Metrics_hpp
+#define Metrics_hpp
+
+#include "Scheduler.hpp"
+
+// Metrics are off unless CLOUDSIM_METRICS is set. Its value is the base name of two CSV files:
+//      <base>.machines.csv     time,machine,s_state,p_state,power_w,utilization,memory_used,active_tasks
+//      <base>.cluster.csv      time,power_w,energy_kwh,tasks_in_flight, then completed/violated/in_flight/late per SLA
+// A sample is taken on the first timer tick of every CLOUDSIM_METRICS_INTERVAL us (default 1 s).
+// Power is the average since the previous sample, utilization the active tasks per core. A sample
+// is one Metrics_Machine() call per machine followed by Metrics_Cluster(). Rows are
+// formatted into large buffers that a writer thread hands to the file system, so the event loop
+// never waits on I/O.
+extern bool             metrics_enabled;
+
+extern void             Metrics_Init();                         // Reads CLOUDSIM_METRICS, call from InitScheduler()
+extern bool             Metrics_Due(Time_t now);                // True when a sample should be taken on this tick
+extern void             Metrics_Machine(Time_t time, MachineId_t machine_id, MachineState_t s_state, CPUPerformance_t p_state,
+                                        uint64_t energy, double utilization, unsigned memory_used, unsigned active_tasks);
+extern void             Metrics_Cluster(Time_t time, double energy_kwh, const SLACounts_t * sla);   // sla has NUM_SLAS entries
+extern void             Metrics_Close();                        // Writes what is left and stops the writer, call from SimulationComplete()
+extern void             Metrics_Detach();                       // Turns metrics off in a forked process without touching the writer
+
+#endif /* Metrics_hpp */
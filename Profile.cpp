@@ -0,0 +1,129 @@
+//
+//  Profile.cpp
+//  CloudSim
+//
+//  Wall-clock instrumentation of the scheduler callbacks.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sys/resource.h>
+
+#include "Profile.hpp"
+
+bool profile_enabled = false;
+
+static const char * callback_names[PROFILE_CALLBACKS] = {
+    "InitScheduler", "HandleNewTask", "HandleNewTasks", "HandleTaskCompletion", "MemoryPressure", "MemoryWarning", "MigrationDone",
+    "SchedulerCheck", "SimulationComplete", "SLARisk", "SLAWarning", "StateChangeComplete"
+};
+static const char * event_names[PROFILE_CALLBACKS] = {
+    "-", "TaskArrivalEvent", "-", "TaskCompletionEvent", "-", "-", "MigrationEvent",
+    "TimerEvent", "-", "-", "-", "-"
+};
+
+// Taken during static initialization, before main() reads the input file
+static ProfileClock_t::time_point process_start = ProfileClock_t::now();
+static ProfileClock_t::time_point init_time;
+static string json_file;
+static uint64_t calls[PROFILE_CALLBACKS];
+static uint64_t nanoseconds[PROFILE_CALLBACKS];
+static uint64_t scheduler_nanoseconds = 0;     // Outermost callbacks only, nested ones are already in it
+static unsigned depth = 0;
+static unsigned tasks_in_flight = 0;
+static unsigned peak_tasks_in_flight = 0;
+
+static uint64_t Elapsed(ProfileClock_t::time_point from, ProfileClock_t::time_point to) {
+    return uint64_t(chrono::duration_cast<chrono::nanoseconds>(to - from).count());
+}
+
+void Profile_Enter(ProfileCallback_t callback) {
+    depth++;
+    if(callback == PROFILE_NEW_TASK) {
+        tasks_in_flight++;
+        peak_tasks_in_flight = max(peak_tasks_in_flight, tasks_in_flight);
+    }
+    else if(callback == PROFILE_TASK_COMPLETION && tasks_in_flight > 0)
+        tasks_in_flight--;
+}
+
+void Profile_Exit(ProfileCallback_t callback, ProfileClock_t::time_point start) {
+    uint64_t elapsed = Elapsed(start, ProfileClock_t::now());
+    calls[callback]++;
+    nanoseconds[callback] += elapsed;
+    if(--depth == 0)
+        scheduler_nanoseconds += elapsed;
+}
+
+void Profile_Init() {
+    const char * setting = getenv("CLOUDSIM_PROFILE");
+    if(!setting)
+        return;
+    init_time = ProfileClock_t::now();
+    string value(setting);
+    if(value.size() > 5 && value.compare(value.size() - 5, 5, ".json") == 0)
+        json_file = value;
+    profile_enabled = true;
+}
+
+void Profile_Report(Time_t time) {
+    if(!profile_enabled)
+        return;
+    ProfileClock_t::time_point end = ProfileClock_t::now();
+    uint64_t run_nanoseconds = Elapsed(init_time, end);
+    uint64_t engine_nanoseconds = run_nanoseconds > scheduler_nanoseconds ? run_nanoseconds - scheduler_nanoseconds : 0;
+    uint64_t events = calls[PROFILE_NEW_TASK] + calls[PROFILE_TASK_COMPLETION] + calls[PROFILE_MIGRATION_DONE] + calls[PROFILE_SCHEDULER_CHECK];
+    double run_seconds = double(run_nanoseconds) / 1e9;
+    double startup_ms = double(Elapsed(process_start, init_time)) / 1e6;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    long peak_rss_kb = usage.ru_maxrss;
+
+    if(json_file.empty()) {
+        char line[160];
+        cout << "Simulation profile" << endl;
+        snprintf(line, sizeof(line), "%-22s %-20s %12s %12s %10s", "Callback", "Event", "Calls", "Total ms", "Avg us");
+        cout << line << endl;
+        for(unsigned i = 0; i < PROFILE_CALLBACKS; i++) {
+            if(calls[i] == 0)
+                continue;
+            snprintf(line, sizeof(line), "%-22s %-20s %12lu %12.3f %10.3f", callback_names[i], event_names[i],
+                     (unsigned long) calls[i], double(nanoseconds[i]) / 1e6, double(nanoseconds[i]) / 1e3 / double(calls[i]));
+            cout << line << endl;
+        }
+        cout << "Startup: " << startup_ms << " ms" << endl;
+        cout << "Run: " << run_seconds * 1e3 << " ms (scheduler " << double(scheduler_nanoseconds) / 1e6
+             << " ms, engine " << double(engine_nanoseconds) / 1e6 << " ms)" << endl;
+        cout << "Events: " << events << " (" << (run_seconds > 0 ? double(events) / run_seconds : 0) << " per second)" << endl;
+        cout << "Simulated time: " << (run_seconds > 0 ? double(time) / run_seconds : 0) << " us per wall second" << endl;
+        cout << "Peak tasks in flight: " << peak_tasks_in_flight << endl;
+        cout << "Peak RSS: " << peak_rss_kb << " KB" << endl;
+        return;
+    }
+
+    ofstream out(json_file);
+    if(!out.is_open())
+        ThrowException("Profile_Report(): Cannot write ", json_file);
+    out << "{\n  \"callbacks\": {\n";
+    bool first = true;
+    for(unsigned i = 0; i < PROFILE_CALLBACKS; i++) {
+        if(calls[i] == 0)
+            continue;
+        out << (first ? "" : ",\n") << "    \"" << callback_names[i] << "\": {\"event\": \"" << event_names[i]
+            << "\", \"calls\": " << calls[i] << ", \"ns\": " << nanoseconds[i] << "}";
+        first = false;
+    }
+    out << "\n  },\n";
+    out << "  \"startup_ms\": " << startup_ms << ",\n";
+    out << "  \"run_ns\": " << run_nanoseconds << ",\n";
+    out << "  \"scheduler_ns\": " << scheduler_nanoseconds << ",\n";
+    out << "  \"engine_ns\": " << engine_nanoseconds << ",\n";
+    out << "  \"events\": " << events << ",\n";
+    out << "  \"events_per_second\": " << (run_seconds > 0 ? double(events) / run_seconds : 0) << ",\n";
+    out << "  \"simulated_us\": " << time << ",\n";
+    out << "  \"simulated_us_per_second\": " << (run_seconds > 0 ? double(time) / run_seconds : 0) << ",\n";
+    out << "  \"peak_tasks_in_flight\": " << peak_tasks_in_flight << ",\n";
+    out << "  \"peak_rss_kb\": " << peak_rss_kb << "\n}\n";
+}
@@ -0,0 +1,63 @@
+//
+//  Profile.hpp
+//  CloudSim
+//
+//  Wall-clock instrumentation of the scheduler callbacks.
+//
+
+#ifndef Profile_hpp
+#define Profile_hpp
+
+#include <chrono>
+
+#include "Interfaces.h"
+
+// Every call the simulator makes into the scheduler is counted and timed. The simulator modules are
+// prebuilt, so the time between callbacks is reported as engine time, and each callback is labelled
+// with the event that triggers it. Profiling is off unless CLOUDSIM_PROFILE is set: the report is
+// printed when the simulation completes, or written as JSON when the value ends in ".json".
+typedef enum {
+    PROFILE_INIT,                   // InitScheduler
+    PROFILE_NEW_TASK,               // HandleNewTask, TaskArrivalEvent
+    PROFILE_NEW_TASKS,              // HandleNewTasks
+    PROFILE_TASK_COMPLETION,        // HandleTaskCompletion, TaskCompletionEvent
+    PROFILE_MEMORY_PRESSURE,        // MemoryPressure
+    PROFILE_MEMORY_WARNING,         // MemoryWarning
+    PROFILE_MIGRATION_DONE,         // MigrationDone, MigrationEvent
+    PROFILE_SCHEDULER_CHECK,        // SchedulerCheck, TimerEvent
+    PROFILE_SIMULATION_COMPLETE,    // SimulationComplete
+    PROFILE_SLA_RISK,               // SLARisk
+    PROFILE_SLA_WARNING,            // SLAWarning
+    PROFILE_STATE_CHANGE            // StateChangeComplete
+} ProfileCallback_t;
+#define PROFILE_CALLBACKS 12
+
+typedef chrono::steady_clock ProfileClock_t;
+
+extern bool             profile_enabled;
+
+extern void             Profile_Enter(ProfileCallback_t callback);
+extern void             Profile_Exit(ProfileCallback_t callback, ProfileClock_t::time_point start);
+extern void             Profile_Init();                         // Reads CLOUDSIM_PROFILE, call from InitScheduler()
+extern void             Profile_Report(Time_t time);            // Prints or writes the report, call from SimulationComplete()
+
+// Times the enclosing scope as one call of the callback
+class ProfileScope {
+public:
+    ProfileScope(ProfileCallback_t callback) : callback(callback), active(profile_enabled) {
+        if(active) {
+            Profile_Enter(callback);
+            start = ProfileClock_t::now();
+        }
+    }
+    ~ProfileScope() {
+        if(active)
+            Profile_Exit(callback, start);
+    }
+private:
+    ProfileCallback_t callback;
+    bool active;
+    ProfileClock_t::time_point start;
+};
+
+#endif /* Profile_hpp */
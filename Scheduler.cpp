@@ -5,12 +5,426 @@
 //  Created by ELMOOTAZBELLAH ELNOZAHY on 10/20/24.
 //
 
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <type_traits>
+
+#include "Internal_Interfaces.h"
+#include "Metrics.hpp"
+#include "Profile.hpp"
 #include "Scheduler.hpp"
+#include "WhatIf.hpp"
 
-static bool migrating = false;
 static unsigned active_machines = 16;
+static const unsigned TRACE_LOOKAHEAD = 1024;               // Trace tasks created ahead of the clock
+
+// Arrival batching is off by default and every task is placed by its own HandleNewTask() call. The
+// policy turns it on with its batch_arrivals trait, CLOUDSIM_BATCH_WINDOW at any policy. When it is
+// on, arrivals up to batch_window us after the first one of a batch are buffered and handed to
+// HandleNewTasks() together. The simulator has no event to close a batch on its own, but it creates
+// the tasks before they arrive, so the arrival that finds the next known one outside the window
+// delivers the batch and its tasks are placed at the time of their last arrival. SchedulerCheck()
+// delivers whatever is left as well. Completion, migration and state change callbacks run in the
+// middle of the simulator's machine updates, where attaching a task corrupts the CPU states, so
+// they never deliver a batch.
+static bool batch_arrivals = false;                         // From the traits of the policy, see ConfigureBatching()
+static Time_t batch_window = 0;
+static const Time_t SLA_RISK_SLACK = 1000000;               // SLARisk() is called when a task has less slack than this
+
+void Cluster::Init() {
+    unsigned total = Machine_GetTotal();
+    machine_info.reserve(total);
+    for(unsigned i = 0; i < total; i++)
+        machine_info.push_back(Machine_GetInfo(MachineId_t(i)));
+    machine_vms.resize(total);
+    memory_free.resize(total);
+    soft_free.resize(total);
+    hard_free.resize(total);
+    memory_level.resize(total);
+    level_queued.resize(total);
+    active_tasks.resize(total);
+    s_state.resize(total);
+    target_state.resize(total);
+    p_state.resize(total);
+    cpu.resize(total);
+    gpu.resize(total);
+    scratch.resize(total);
+    for(unsigned i = 0; i < total; i++) {
+        const MachineInfo_t & info = machine_info[i];
+        memory_free[i] = int(info.memory_size) - int(info.memory_used);
+        soft_free[i] = int(uint64_t(info.memory_size) * (100 - MEMORY_SOFT_PERCENT) / 100);
+        hard_free[i] = int(uint64_t(info.memory_size) * (100 - MEMORY_HARD_PERCENT) / 100);
+        memory_level[i] = memory_free[i] <= hard_free[i] ? MEMORY_HARD : memory_free[i] <= soft_free[i] ? MEMORY_SOFT : MEMORY_NORMAL;
+        active_tasks[i] = info.active_tasks;
+        s_state[i] = target_state[i] = uint8_t(info.s_state);
+        p_state[i] = uint8_t(info.p_state);
+        cpu[i] = uint8_t(info.cpu);
+        gpu[i] = uint8_t(info.gpus);
+    }
+    unsigned tasks = GetNumTasks();
+    task_key.resize(tasks);
+    task_loaded.resize(tasks, 0);
+    task_vm.resize(tasks, NO_VM);
+}
+
+void Cluster::LoadTask(TaskId_t task_id) {
+    if(task_id >= task_key.size()) {
+        // Trace replay creates tasks during the run
+        task_key.resize(task_id + 1);
+        task_loaded.resize(task_id + 1, 0);
+        task_vm.resize(task_id + 1, NO_VM);
+    }
+    TaskInfo_t info = GetTaskInfo(task_id);
+    TaskPlacementKey_t & key = task_key[task_id];
+    key.target_completion = info.target_completion;
+    key.memory = info.required_memory;
+    key.cpu = uint8_t(info.required_cpu);
+    key.vm_type = uint8_t(info.required_vm);
+    key.sla = uint8_t(info.required_sla);
+    key.priority = uint8_t(info.priority);
+    key.gpu_capable = info.gpu_capable;
+    task_loaded[task_id] = 1;
+}
+
+const TaskPlacementKey_t & Cluster::GetTaskPlacementKey(TaskId_t task_id) {
+    if(task_id >= task_loaded.size() || !task_loaded[task_id])
+        LoadTask(task_id);
+    return task_key[task_id];
+}
+
+void Cluster::AddTask(VMId_t vm_id, TaskId_t task_id, Priority_t priority) {
+    const TaskPlacementKey_t & task = GetTaskPlacementKey(task_id);
+    VM_AddTask(vm_id, task_id, priority);
+    VMInfo_t & vm = vm_info[vm_id];
+    vm.active_tasks.push_back(task_id);
+    task_vm[task_id] = vm_id;
+    ChargeMemory(vm.machine_id, int(task.memory));
+    ChargeTasks(vm.machine_id, 1);
+}
+
+void Cluster::AttachVM(VMId_t vm_id, MachineId_t machine_id) {
+    VM_Attach(vm_id, machine_id);
+    vm_info[vm_id].machine_id = machine_id;
+    machine_vms[machine_id].push_back(vm_id);
+    ChargeMemory(machine_id, VM_MEMORY_OVERHEAD);
+    machine_info[machine_id].active_vms++;
+}
+
+void Cluster::SyncMachine(MachineId_t machine_id) {
+    // The simulator has its own accounting of migrations: it releases VM_MEMORY_OVERHEAD and the VM
+    // from the source when the migration starts and leaves the memory of the tasks charged there
+    // after it is done. Rather than replay those rules, read back what it charged; migrations are
+    // rare enough for the copy Machine_GetInfo() makes
+    MachineInfo_t info = Machine_GetInfo(machine_id);
+    machine_info[machine_id].active_vms = info.active_vms;
+    int memory = int(info.memory_used) - int(machine_info[machine_id].memory_used);
+    if(memory != 0)
+        ChargeMemory(machine_id, memory);
+}
+
+void Cluster::ChargeMemory(MachineId_t machine_id, int memory) {
+    machine_info[machine_id].memory_used += memory;
+    int left = memory_free[machine_id] -= memory;
+    uint8_t level = left <= hard_free[machine_id] ? MEMORY_HARD : left <= soft_free[machine_id] ? MEMORY_SOFT : MEMORY_NORMAL;
+    if(level != memory_level[machine_id]) {
+        memory_level[machine_id] = level;
+        if(!level_queued[machine_id]) {
+            level_queued[machine_id] = 1;
+            level_changes.push_back(machine_id);
+        }
+    }
+}
+
+void Cluster::TakeMemoryLevelChanges(vector<MachineId_t> & out) {
+    for(MachineId_t machine_id : level_changes)
+        level_queued[machine_id] = 0;
+    out.swap(level_changes);
+    level_changes.clear();
+}
+
+void Cluster::ChargeTasks(MachineId_t machine_id, int tasks) {
+    machine_info[machine_id].active_tasks += tasks;
+    active_tasks[machine_id] += tasks;
+}
+
+void Cluster::DetachFromMachine(VMId_t vm_id, MachineId_t machine_id) {
+    vector<VMId_t> & attached = machine_vms[machine_id];
+    for(unsigned i = 0; i < attached.size(); i++)
+        if(attached[i] == vm_id) {
+            attached.erase(attached.begin() + i);
+            break;
+        }
+    machine_info[machine_id].active_vms--;
+}
+
+VMId_t Cluster::CreateVM(VMType_t vm_type, CPUType_t cpu) {
+    VMId_t vm_id = VM_Create(vm_type, cpu);
+    if(vm_id >= vm_info.size()) {
+        vm_info.resize(vm_id + 1);
+        migration_target.resize(vm_id + 1, NO_MACHINE);
+    }
+    VMInfo_t & vm = vm_info[vm_id];
+    vm.active_tasks.clear();
+    vm.cpu = cpu;
+    vm.machine_id = NO_MACHINE;
+    vm.vm_id = vm_id;
+    vm.vm_type = vm_type;
+    return vm_id;
+}
+
+unsigned Cluster::FilterMachines(CPUType_t cpu_type, unsigned memory, bool gpu_required, vector<MachineId_t> & out) const {
+    unsigned total = GetTotal();
+    Match(cpu_type, memory, gpu_required, scratch.data());
+    out.clear();
+    for(unsigned i = 0; i < total; i++)
+        if(scratch[i])
+            out.push_back(MachineId_t(i));
+    return unsigned(out.size());
+}
+
+MachineId_t Cluster::FindLeastLoaded(CPUType_t cpu_type, unsigned memory, bool gpu_required) const {
+    unsigned total = GetTotal();
+    Match(cpu_type, memory, gpu_required, scratch.data());
+    // The first pass computes the minimum load without branches (a rejected machine ors its load
+    // with all ones), the second finds its position
+    const uint8_t * __restrict mask = scratch.data();
+    const unsigned * __restrict load = active_tasks.data();
+    unsigned least = UINT_MAX;
+    for(unsigned i = 0; i < total; i++)
+        least = min(least, load[i] | (unsigned(mask[i]) - 1));
+    if(least == UINT_MAX)
+        return NO_MACHINE;
+    for(unsigned i = 0; i < total; i++)
+        if(mask[i] && load[i] == least)
+            return MachineId_t(i);
+    return NO_MACHINE;
+}
+
+void Cluster::Match(CPUType_t cpu_type, unsigned memory, bool gpu_required, uint8_t * mask) const {
+    // Local column pointers and a restrict-qualified mask let the compiler vectorize the scan;
+    // otherwise every byte store to the mask may alias the vector internals and the columns
+    unsigned total = GetTotal();
+    const int * __restrict free = memory_free.data();
+    const uint8_t * __restrict state = s_state.data();
+    const uint8_t * __restrict target = target_state.data();
+    const uint8_t * __restrict type = cpu.data();
+    const uint8_t * __restrict has_gpu = gpu.data();
+    uint8_t * __restrict out = mask;
+    uint8_t no_gpu_needed = !gpu_required;
+    for(unsigned i = 0; i < total; i++)
+        out[i] = (state[i] == S0) & (target[i] == S0) & (type[i] == cpu_type)
+               & (free[i] >= int(memory)) & (has_gpu[i] | no_gpu_needed);
+}
+
+void Cluster::MigrateVM(VMId_t vm_id, MachineId_t machine_id) {
+    VM_Migrate(vm_id, machine_id);
+    migration_target[vm_id] = machine_id;
+    // The tasks of the VM stop running on the source for the duration of the migration
+    ChargeTasks(vm_info[vm_id].machine_id, -int(vm_info[vm_id].active_tasks.size()));
+    SyncMachine(vm_info[vm_id].machine_id);
+}
+
+void Cluster::MigrationComplete(VMId_t vm_id) {
+    VMInfo_t & vm = vm_info[vm_id];
+    MachineId_t source = vm.machine_id;
+    MachineId_t target = migration_target[vm_id];
+    DetachFromMachine(vm_id, source);
+    machine_vms[target].push_back(vm_id);
+    SyncMachine(source);
+    SyncMachine(target);
+    ChargeTasks(target, int(vm.active_tasks.size()));
+    vm.machine_id = target;
+    migration_target[vm_id] = NO_MACHINE;
+}
+
+void Cluster::SetCorePerformance(MachineId_t machine_id, unsigned core_id, CPUPerformance_t p_state) {
+    // The simulator applies the P-state to every core of the machine, so retuning a machine to the
+    // state it is already in (a policy setting each core in turn, or every SchedulerCheck()) is a no-op
+    if(machine_id < this->p_state.size() && this->p_state[machine_id] == uint8_t(p_state))
+        return;
+    Machine_SetCorePerformance(machine_id, core_id, p_state);
+    machine_info[machine_id].p_state = p_state;
+    this->p_state[machine_id] = uint8_t(p_state);
+}
+
+void Cluster::SetState(MachineId_t machine_id, MachineState_t s_state) {
+    // The simulator completes a request for the state the machine is in right away, from inside
+    // Machine_SetState(), so the target has to be set first
+    target_state[machine_id] = uint8_t(s_state);
+    Machine_SetState(machine_id, s_state);
+}
+
+void Cluster::ShutdownVM(VMId_t vm_id) {
+    VM_Shutdown(vm_id);
+    VMInfo_t & vm = vm_info[vm_id];
+    if(vm.machine_id != NO_MACHINE) {
+        int memory = VM_MEMORY_OVERHEAD;
+        for(TaskId_t task_id : vm.active_tasks) {
+            memory += task_key[task_id].memory;
+            task_vm[task_id] = NO_VM;
+        }
+        ChargeMemory(vm.machine_id, -memory);
+        if(!IsMigrating(vm_id))
+            ChargeTasks(vm.machine_id, -int(vm.active_tasks.size()));
+        DetachFromMachine(vm_id, vm.machine_id);
+    }
+    vm.active_tasks.clear();
+    vm.machine_id = NO_MACHINE;
+    migration_target[vm_id] = NO_MACHINE;
+}
+
+unsigned Cluster::GetVMMemory(VMId_t vm_id) const {
+    unsigned memory = VM_MEMORY_OVERHEAD;
+    for(TaskId_t task_id : vm_info[vm_id].active_tasks)
+        memory += task_key[task_id].memory;
+    return memory;
+}
+
+void Cluster::StateChangeComplete(MachineId_t machine_id) {
+    // Read the state back: a request that reverts a transition in flight completes right away, but
+    // the simulator keeps the earlier transition running and completes that one later as well
+    MachineState_t state = Machine_GetInfo(machine_id).s_state;
+    s_state[machine_id] = target_state[machine_id] = uint8_t(state);
+    machine_info[machine_id].s_state = state;
+}
+
+MachineId_t Cluster::TaskComplete(TaskId_t task_id) {
+    if(task_id >= task_vm.size() || task_vm[task_id] == NO_VM)
+        return NO_MACHINE;
+    VMInfo_t & vm = vm_info[task_vm[task_id]];
+    task_vm[task_id] = NO_VM;
+    for(unsigned i = 0; i < vm.active_tasks.size(); i++)
+        if(vm.active_tasks[i] == task_id) {
+            vm.active_tasks[i] = vm.active_tasks.back();
+            vm.active_tasks.pop_back();
+            break;
+        }
+    ChargeMemory(vm.machine_id, -int(task_key[task_id].memory));
+    if(!IsMigrating(vm.vm_id))
+        ChargeTasks(vm.machine_id, -1);
+    return vm.machine_id;
+}
+
+static const unsigned CPU_TYPES = X86 + 1;
+static const unsigned VM_TYPES = AIX + 1;
+
+unsigned PlacementIndex::BucketOf(CPUType_t cpu, VMType_t vm_type, bool gpu) {
+    return (unsigned(cpu) * VM_TYPES + unsigned(vm_type)) * 2 + (gpu ? 1 : 0);
+}
+
+void PlacementIndex::Init() {
+    buckets.clear();
+    buckets.resize(CPU_TYPES * VM_TYPES * 2);
+    for(Bucket_t & bucket : buckets) {
+        bucket.leaves = 1;
+        bucket.max_free.assign(2, INT_MIN);
+    }
+    entries.clear();
+    for(VMId_t vm_id = 0; vm_id < cluster.GetVMTotal(); vm_id++)
+        UpdateVM(vm_id);
+}
+
+VMId_t PlacementIndex::Find(Fit_t fit, CPUType_t cpu, VMType_t vm_type, bool gpu, unsigned memory) const {
+    const Bucket_t & bucket = buckets[BucketOf(cpu, vm_type, gpu)];
+    int needed = int(memory);
+    if(bucket.by_memory.empty() || bucket.by_memory.rbegin()->memory_free < needed)
+        return Cluster::NO_VM;
+    switch(fit) {
+        case BEST_FIT:
+            return bucket.by_memory.lower_bound(Key_t{needed, 0, 0})->vm_id;
+        case WORST_FIT:
+            // Among the machines with the most free memory, the least loaded
+            return bucket.by_memory.lower_bound(Key_t{bucket.by_memory.rbegin()->memory_free, 0, 0})->vm_id;
+        case FIRST_FIT: {
+            unsigned node = 1;
+            while(node < bucket.leaves)
+                node = bucket.max_free[2 * node] >= needed ? 2 * node : 2 * node + 1;
+            return bucket.slot_vm[node - bucket.leaves];
+        }
+    }
+    return Cluster::NO_VM;
+}
+
+void PlacementIndex::SetSlot(Bucket_t & bucket, VMId_t vm_id, int memory_free) {
+    unsigned slot;
+    auto found = bucket.slot.find(vm_id);
+    if(found != bucket.slot.end())
+        slot = found->second;
+    else if(memory_free == INT_MIN)
+        return;
+    else if(!bucket.free_slots.empty()) {
+        slot = bucket.free_slots.back();
+        bucket.free_slots.pop_back();
+        bucket.slot[vm_id] = slot;
+        bucket.slot_vm[slot] = vm_id;
+    }
+    else {
+        slot = unsigned(bucket.slot_vm.size());
+        bucket.slot[vm_id] = slot;
+        bucket.slot_vm.push_back(vm_id);
+        if(slot == bucket.leaves) {
+            // Out of leaves, double the tree
+            unsigned leaves = bucket.leaves * 2;
+            vector<int> max_free(2 * leaves, INT_MIN);
+            copy(bucket.max_free.begin() + bucket.leaves, bucket.max_free.end(), max_free.begin() + leaves);
+            for(unsigned node = leaves - 1; node > 0; node--)
+                max_free[node] = max(max_free[2 * node], max_free[2 * node + 1]);
+            bucket.max_free.swap(max_free);
+            bucket.leaves = leaves;
+        }
+    }
+    unsigned node = bucket.leaves + slot;
+    bucket.max_free[node] = memory_free;
+    for(node /= 2; node > 0; node /= 2)
+        bucket.max_free[node] = max(bucket.max_free[2 * node], bucket.max_free[2 * node + 1]);
+}
+
+void PlacementIndex::FreeSlot(Bucket_t & bucket, VMId_t vm_id) {
+    // The leaf is already INT_MIN, the VM left the index first
+    auto found = bucket.slot.find(vm_id);
+    if(found == bucket.slot.end())
+        return;
+    bucket.slot_vm[found->second] = Cluster::NO_VM;
+    bucket.free_slots.push_back(found->second);
+    bucket.slot.erase(found);
+}
+
+void PlacementIndex::UpdateMachine(MachineId_t machine_id) {
+    for(VMId_t vm_id : cluster.GetVMs(machine_id))
+        UpdateVM(vm_id);
+}
+
+void PlacementIndex::UpdateVM(VMId_t vm_id) {
+    if(vm_id >= entries.size())
+        entries.resize(vm_id + 1, Entry_t{false, 0, Key_t{0, 0, 0}});
+    Entry_t & entry = entries[vm_id];
+    if(entry.indexed) {
+        Bucket_t & bucket = buckets[entry.bucket];
+        bucket.by_memory.erase(entry.key);
+        SetSlot(bucket, vm_id, INT_MIN);
+        entry.indexed = false;
+    }
+    const VMInfo_t & vm = cluster.GetVMInfo(vm_id);
+    if(vm.machine_id == Cluster::NO_MACHINE) {
+        // Shut down, or not attached yet. A VM that moved between machines with and without a GPU
+        // holds a slot in both buckets of its type
+        FreeSlot(buckets[BucketOf(vm.cpu, vm.vm_type, false)], vm_id);
+        FreeSlot(buckets[BucketOf(vm.cpu, vm.vm_type, true)], vm_id);
+        return;
+    }
+    if(cluster.IsMigrating(vm_id) || !cluster.IsReady(vm.machine_id))
+        return;
+    entry.indexed = true;
+    entry.bucket = BucketOf(vm.cpu, vm.vm_type, cluster.GetMachineInfo(vm.machine_id).gpus);
+    entry.key = Key_t{cluster.GetMemoryFree(vm.machine_id), cluster.GetActiveTasks(vm.machine_id), vm_id};
+    Bucket_t & bucket = buckets[entry.bucket];
+    bucket.by_memory.insert(entry.key);
+    SetSlot(bucket, vm_id, entry.key.memory_free);
+}
 
-void Scheduler::Init() {
+template<class P>
+void Scheduler::Init(P & policy) {
     // Find the parameters of the clusters
     // Get the total number of machines
     // For each machine:
@@ -19,130 +433,999 @@ void Scheduler::Init() {
     //      Get the number of CPUs
     //      Get if there is a GPU or not
     // 
-    SimOutput("Scheduler::Init(): Total number of machines is " + to_string(Machine_GetTotal()), 3);
-    SimOutput("Scheduler::Init(): Initializing scheduler", 1);
+    SIM_OUTPUT("Scheduler::Init(): Total number of machines is " + to_string(Machine_GetTotal()), 3);
+    SIM_OUTPUT("Scheduler::Init(): Initializing scheduler", 1);
+    cluster.Init();
+    gpus.Init();
+    risk.Init(SLA_RISK_SLACK);
+    migrations.Init();
+    power.Init();
+    pool.Init();
+    pacer = CheckPacer(P::adaptive_checks);
+    // The pool updates the placement index as the policy prewarms, and the index is then rebuilt
+    // from every VM the policy set up, through the cluster or not
+    placement.Init();
+    policy.Init(*this);
+    placement.Init();
+}
+
+template<class P>
+void Scheduler::Adopt(P & policy) {
+    // The models keep their state, the new policy sets up its VMs next to the ones already running
+    pacer = CheckPacer(P::adaptive_checks);
+    policy.Init(*this);
+    placement.Init();
+}
+
+template<class P>
+void Scheduler::MigrationComplete(P & policy, Time_t time, VMId_t vm_id) {
+    // Update your data structure. The VM now can receive new tasks
+    MachineId_t source = cluster.GetVMInfo(vm_id).machine_id;
+    migrations.MigrationComplete(time, vm_id);
+    cluster.MigrationComplete(vm_id);
+    gpus.UpdateVM(time, vm_id);
+    placement.UpdateMachine(source);
+    placement.UpdateMachine(cluster.GetVMInfo(vm_id).machine_id);
+    policy.MigrationComplete(*this, time, vm_id);
+}
+
+template<class P>
+void Scheduler::NewTasks(P & policy, Time_t now, const TaskId_t * task_ids, size_t count) {
+    // Every task of the batch is known here, so the tasks can be placed in one pass, e.g. sorted by
+    // decreasing memory and packed with placement.Find(BEST_FIT, ...)
+    for(size_t i = 0; i < count; i++)
+        risk.Add(now, task_ids[i], cluster.GetTaskPlacementKey(task_ids[i]));
+    policy.NewTasks(*this, now, task_ids, count);
+}
+
+template<class P>
+void Scheduler::NewTask(P & policy, Time_t now, TaskId_t task_id) {
+    risk.Add(now, task_id, cluster.GetTaskPlacementKey(task_id));
+    policy.NewTask(*this, now, task_id);
+}
+
+template<class P>
+void Scheduler::PeriodicCheck(P & policy, Time_t now) {
+    // This method should be called from SchedulerCheck()
+    // SchedulerCheck is called periodically by the simulator to allow you to monitor, make decisions, adjustments, etc.
+    // Unlike the other invocations of the scheduler, this one doesn't report any specific event
+    // Recommendation: Take advantage of this function to do some monitoring and adjustments as necessary
+    policy.PeriodicCheck(*this, now);
+}
+
+template<class P>
+void Scheduler::Shutdown(P & policy, Time_t time) {
+    // Do your final reporting and bookkeeping here.
+    // Report about the total energy consumed
+    // Report about the SLA compliance
+    // Shutdown everything to be tidy :-)
+    policy.Shutdown(*this, time);
+    migrations.Report();
+    gpus.Report(time);
+    pool.Report();
+    SIM_OUTPUT("SimulationComplete(): Finished!", 4);
+    SIM_OUTPUT("SimulationComplete(): Time is " + to_string(time), 4);
+}
+
+template<class P>
+void Scheduler::StateChangeComplete(P & policy, Time_t time, MachineId_t machine_id) {
+    cluster.StateChangeComplete(machine_id);
+    gpus.StateChangeComplete(time, machine_id);
+    placement.UpdateMachine(machine_id);
+    policy.StateChangeComplete(*this, time, machine_id);
+}
+
+template<class P>
+void Scheduler::SLARisk(P & policy, Time_t now, TaskId_t task_id) {
+    // The task is projected to finish less than SLA_RISK_SLACK before its target completion, or
+    // after it. There is still time to raise its priority (SetTaskPriority()), move it to a less
+    // loaded machine, or speed up its machine
+    policy.SLARisk(*this, now, task_id);
+}
+
+template<class P>
+void Scheduler::TaskComplete(P & policy, Time_t now, TaskId_t task_id) {
+    // Do any bookkeeping necessary for the data structures
+    // Decide if a machine is to be turned off, slowed down, or VMs to be migrated according to your policy
+    // This is an opportunity to make any adjustments to optimize performance/energy
+    risk.Remove(task_id);
+    VMId_t vm_id = cluster.GetTaskVM(task_id);
+    MachineId_t machine_id = cluster.TaskComplete(task_id);
+    gpus.TaskComplete(now, task_id);
+    if(machine_id != Cluster::NO_MACHINE)
+        placement.UpdateMachine(machine_id);
+    SIM_OUTPUT("Scheduler::TaskComplete(): Task " + to_string(task_id) + " is complete at " + to_string(now), 4);
+    policy.TaskComplete(*this, now, task_id, vm_id);
+}
+
+template<class P>
+void Scheduler::MemoryPressure(P & policy, Time_t now, MachineId_t machine_id, MemoryLevel_t level) {
+    // The memory in use on the machine crossed a watermark, up or down. Before it overflows there
+    // is still time to place new tasks elsewhere or migrate a VM away
+    policy.MemoryPressure(*this, now, machine_id, level);
+}
+
+void Scheduler::TimerTick(Time_t now) {
+    // Called on every timer tick, before PeriodicCheck() and whatever the pacer decides
+    changed.clear();
+    power.Tick(now, changed);
+    for(MachineId_t machine_id : changed)
+        placement.UpdateMachine(machine_id);
+    if(Metrics_Due(now))
+        SampleMetrics(now);
+    // The risk index paces itself with its recheck heap, it must not wait for a paced check
+    at_risk.clear();
+    risk.Check(now, at_risk);
+    for(TaskId_t task_id : at_risk)
+        ::SLARisk(now, task_id);
+}
+
+void Scheduler::DeliverMemoryPressure(Time_t now) {
+    // Levels can change again while the scheduler reacts, deliver until they settle
+    for(;;) {
+        cluster.TakeMemoryLevelChanges(pressure);
+        if(pressure.empty())
+            return;
+        for(MachineId_t machine_id : pressure)
+            ::MemoryPressure(now, machine_id, cluster.GetMemoryLevel(machine_id));
+    }
+}
+
+void Scheduler::AddTask(Time_t now, VMId_t vm_id, TaskId_t task_id, Priority_t priority) {
+    cluster.AddTask(vm_id, task_id, priority);
+    gpus.TaskPlaced(now, task_id);
+    placement.UpdateMachine(cluster.GetVMInfo(vm_id).machine_id);
+}
+
+void Scheduler::MigrateVM(Time_t now, VMId_t vm_id, MachineId_t machine_id) {
+    pool.Evict(vm_id);
+    cluster.MigrateVM(vm_id, machine_id);
+    migrations.MigrationStarted(now, vm_id);
+    gpus.UpdateVM(now, vm_id);
+    placement.UpdateMachine(cluster.GetVMInfo(vm_id).machine_id);
+}
+
+void Scheduler::SetState(MachineId_t machine_id, MachineState_t s_state) {
+    cluster.SetState(machine_id, s_state);
+    placement.UpdateMachine(machine_id);
+}
+
+void Scheduler::ShutdownVM(VMId_t vm_id) {
+    pool.Evict(vm_id);
+    cluster.ShutdownVM(vm_id);
+    placement.UpdateVM(vm_id);
+}
+
+void Scheduler::SampleMetrics(Time_t now) {
+    for(unsigned i = 0; i < cluster.GetTotal(); i++) {
+        MachineId_t machine_id = MachineId_t(i);
+        const MachineInfo_t & machine = cluster.GetMachineInfo(machine_id);
+        double utilization = machine.num_cpus ? double(cluster.GetActiveTasks(machine_id)) / machine.num_cpus : 0;
+        Metrics_Machine(now, machine_id, cluster.GetState(machine_id), machine.p_state, Machine_GetEnergy(machine_id),
+                        utilization, cluster.GetMemoryUsed(machine_id), cluster.GetActiveTasks(machine_id));
+    }
+    SLACounts_t sla[NUM_SLAS];
+    for(unsigned i = 0; i < NUM_SLAS; i++)
+        sla[i] = sla_stats.Get(SLAType_t(i), now);
+    Metrics_Cluster(now, Machine_GetClusterEnergy(), sla);
+}
+
+bool CheckPacer::Due(Time_t now) {
+    if(requested) {
+        if(now < next_check)
+            return false;
+        requested = false;
+        activity = false;
+        return true;
+    }
+    if(!adaptive)
+        return true;
+    if(activity) {
+        activity = false;
+        backoff = 1;
+        skipped = 0;
+        return true;
+    }
+    if(++skipped < backoff)
+        return false;
+    skipped = 0;
+    backoff = min(backoff * 2, unsigned(CHECK_BACKOFF_MAX));
+    return true;
+}
+
+void CheckPacer::Request(Time_t when) {
+    requested = true;
+    next_check = when;
+}
+
+static const uint8_t TASK_SLA_MASK = 0x3;
+static const uint8_t TASK_IN_FLIGHT = 0x4;
+static const uint8_t TASK_LATE = 0x8;
+
+void SLAStats::TaskArrived(TaskId_t task_id) {
+    if(task_id >= state.size())
+        state.resize(task_id + 1);
+    // Loads the task for the placement that follows as well
+    const TaskPlacementKey_t & task = cluster.GetTaskPlacementKey(task_id);
+    state[task_id] = task.sla | TASK_IN_FLIGHT;
+    counts[task.sla].in_flight++;
+    deadlines.push(Deadline_t(task.target_completion, task_id));
+}
+
+void SLAStats::TaskCompleted(Time_t time, TaskId_t task_id) {
+    if(task_id >= state.size() || !(state[task_id] & TASK_IN_FLIGHT))
+        return;
+    SLACounts_t & sla = counts[state[task_id] & TASK_SLA_MASK];
+    sla.in_flight--;
+    if(state[task_id] & TASK_LATE)
+        sla.late--;
+    sla.completed++;
+    if(time > cluster.GetTaskPlacementKey(task_id).target_completion)
+        sla.violated++;
+    state[task_id] &= TASK_SLA_MASK;
+}
+
+const SLACounts_t & SLAStats::Get(SLAType_t sla, Time_t now) {
+    // Every task passes its target once, completed tasks are dropped when they come up
+    while(!deadlines.empty() && deadlines.top().first < now) {
+        TaskId_t task_id = deadlines.top().second;
+        deadlines.pop();
+        if(state[task_id] & TASK_IN_FLIGHT) {
+            state[task_id] |= TASK_LATE;
+            counts[state[task_id] & TASK_SLA_MASK].late++;
+        }
+    }
+    return counts[sla];
+}
+
+void GPUModel::Init() {
+    unsigned total = cluster.GetTotal();
+    slots.assign(total, 0);
+    used.assign(total, 0);
+    energy.assign(total, 0);
+    power.assign(total, 0);
+    last_update.assign(total, 0);
+    for(unsigned i = 0; i < total; i++) {
+        if(cluster.GetMachineInfo(MachineId_t(i)).gpus)
+            slots[i] = GPU_SLOTS;
+        Integrate(0, MachineId_t(i));
+    }
+}
+
+GPUState_t GPUModel::GetState(MachineId_t machine_id) const {
+    if(slots[machine_id] == 0 || cluster.GetState(machine_id) != S0)
+        return GPU_OFF;
+    return used[machine_id] ? GPU_ACTIVE : GPU_IDLE;
+}
+
+unsigned GPUModel::Speedup(TaskId_t task_id) const {
+    return task_id < task_slot.size() && task_slot[task_id] != Cluster::NO_MACHINE ? GPU_SPEEDUP : 1;
+}
+
+uint64_t GPUModel::GetEnergy(Time_t now, MachineId_t machine_id) const {
+    // W times us is uJ
+    return uint64_t(energy[machine_id] + power[machine_id] * double(now - last_update[machine_id]));
+}
+
+double GPUModel::GetClusterEnergy(Time_t now) const {
+    double total = 0;
+    for(unsigned i = 0; i < slots.size(); i++)
+        total += double(GetEnergy(now, MachineId_t(i)));
+    // 1 KW-Hour is 3.6e12 uJ
+    return total / 3.6e12;
+}
+
+void GPUModel::TaskPlaced(Time_t now, TaskId_t task_id) {
+    const TaskPlacementKey_t & task = cluster.GetTaskPlacementKey(task_id);
+    VMId_t vm_id = cluster.GetTaskVM(task_id);
+    if(!task.gpu_capable || vm_id == Cluster::NO_VM || cluster.IsMigrating(vm_id))
+        return;
+    MachineId_t machine_id = cluster.GetVMInfo(vm_id).machine_id;
+    if(used[machine_id] == slots[machine_id])
+        return;
+    if(task_id >= task_slot.size())
+        task_slot.resize(task_id + 1, Cluster::NO_MACHINE);
+    if(task_slot[task_id] != Cluster::NO_MACHINE)
+        return;
+    task_slot[task_id] = machine_id;
+    used[machine_id]++;
+    grants++;
+    peak = max(peak, ++in_use);
+    Integrate(now, machine_id);
+}
+
+void GPUModel::TaskComplete(Time_t now, TaskId_t task_id) {
+    MachineId_t machine_id = Release(now, task_id);
+    if(machine_id != Cluster::NO_MACHINE)
+        Fill(now, machine_id);
+}
+
+void GPUModel::UpdateVM(Time_t now, VMId_t vm_id) {
+    // The tasks of a migrating VM do not run, they give up their slots until it is attached again
+    vector<MachineId_t> released;
+    for(TaskId_t task_id : cluster.GetVMInfo(vm_id).active_tasks) {
+        MachineId_t machine_id = Release(now, task_id);
+        if(machine_id != Cluster::NO_MACHINE && find(released.begin(), released.end(), machine_id) == released.end())
+            released.push_back(machine_id);
+    }
+    for(MachineId_t machine_id : released)
+        Fill(now, machine_id);
+    if(!cluster.IsMigrating(vm_id))
+        for(TaskId_t task_id : cluster.GetVMInfo(vm_id).active_tasks)
+            TaskPlaced(now, task_id);
+}
+
+void GPUModel::StateChangeComplete(Time_t now, MachineId_t machine_id) {
+    Integrate(now, machine_id);
+}
+
+void GPUModel::Report(Time_t now) const {
+    if(grants == 0)
+        return;
+    unsigned total = 0;
+    for(unsigned machine_slots : slots)
+        total += machine_slots;
+    SIM_OUTPUT("GPUModel: " + to_string(grants) + " slots handed out, at most " + to_string(peak) + " of " + to_string(total)
+               + " in use, modeled GPU energy " + to_string(GetClusterEnergy(now)) + " KW-Hour", 1);
+}
+
+void GPUModel::Fill(Time_t now, MachineId_t machine_id) {
+    for(VMId_t vm_id : cluster.GetVMs(machine_id)) {
+        if(cluster.IsMigrating(vm_id))
+            continue;
+        for(TaskId_t task_id : cluster.GetVMInfo(vm_id).active_tasks) {
+            if(used[machine_id] == slots[machine_id])
+                return;
+            TaskPlaced(now, task_id);
+        }
+    }
+}
+
+void GPUModel::Integrate(Time_t now, MachineId_t machine_id) {
+    energy[machine_id] += power[machine_id] * double(now - last_update[machine_id]);
+    last_update[machine_id] = now;
+    switch(GetState(machine_id)) {
+        case GPU_OFF:
+            power[machine_id] = 0;
+            break;
+        case GPU_IDLE:
+            power[machine_id] = GPU_IDLE_POWER;
+            break;
+        case GPU_ACTIVE:
+            power[machine_id] = GPU_IDLE_POWER + double(GPU_ACTIVE_POWER - GPU_IDLE_POWER) * used[machine_id] / slots[machine_id];
+            break;
+    }
+}
+
+MachineId_t GPUModel::Release(Time_t now, TaskId_t task_id) {
+    if(task_id >= task_slot.size() || task_slot[task_id] == Cluster::NO_MACHINE)
+        return Cluster::NO_MACHINE;
+    MachineId_t machine_id = task_slot[task_id];
+    task_slot[task_id] = Cluster::NO_MACHINE;
+    used[machine_id]--;
+    in_use--;
+    Integrate(now, machine_id);
+    return machine_id;
+}
+
+void SLARiskIndex::Add(Time_t now, TaskId_t task_id, const TaskPlacementKey_t & task) {
+    if(task.sla == SLA3)
+        return;
+    if(task_id >= tracked.size()) {
+        target.resize(task_id + 1);
+        tracked.resize(task_id + 1);
+    }
+    target[task_id] = task.target_completion;
+    tracked[task_id] = 1;
+    checks.push(Check_t(now, task_id));
+}
+
+void SLARiskIndex::Remove(TaskId_t task_id) {
+    if(task_id < tracked.size())
+        tracked[task_id] = 0;
+}
+
+void SLARiskIndex::Check(Time_t now, vector<TaskId_t> & at_risk) {
+    while(!checks.empty() && checks.top().first <= now) {
+        TaskId_t task_id = checks.top().second;
+        checks.pop();
+        if(!tracked[task_id])
+            continue;
+        Time_t next = now + SLA_RISK_RECHECK;
+        VMId_t vm_id = cluster.GetTaskVM(task_id);
+        // Tasks that wait for a VM or are being migrated make no progress, their slack is target - now
+        Time_t duration = 0;
+        if(vm_id != Cluster::NO_VM && !cluster.IsMigrating(vm_id)) {
+            MachineId_t machine_id = cluster.GetVMInfo(vm_id).machine_id;
+            const MachineInfo_t & machine = cluster.GetMachineInfo(machine_id);
+            uint64_t mips = machine.performance[machine.p_state] * gpus.Speedup(task_id);
+            unsigned tasks = cluster.GetActiveTasks(machine_id);
+            if(tasks > machine.num_cpus)
+                mips = mips * machine.num_cpus / tasks;
+            duration = mips ? GetRemainingInstructions(task_id) / mips : target[task_id];
+        }
+        if(now + duration + threshold >= target[task_id]) {
+            tracked[task_id] = 0;
+            at_risk.push_back(task_id);
+            continue;
+        }
+        checks.push(Check_t(min(next, target[task_id] - threshold - duration), task_id));
+    }
+}
+
+void MigrationModel::Init() {
+    link_users.assign(cluster.GetTotal(), 0);
+}
+
+MigrationCost_t MigrationModel::Estimate(VMId_t vm_id, MachineId_t target) const {
+    if(vm_id >= cluster.GetVMTotal() || cluster.GetVMInfo(vm_id).machine_id == Cluster::NO_MACHINE)
+        ThrowException("MigrationModel::Estimate(): VM is not attached to a machine ", vm_id);
+    if(target >= cluster.GetTotal())
+        ThrowException("MigrationModel::Estimate(): No such target machine ", target);
+    MachineId_t source = cluster.GetVMInfo(vm_id).machine_id;
+    unsigned sharing = max(link_users[source], link_users[target]) + 1;
+    double bandwidth = double(MIGRATION_BANDWIDTH) / sharing;                   // MB/s
+    double dirty_rate = double(MIGRATION_DIRTY_RATE) * cluster.GetVMInfo(vm_id).active_tasks.size();
+    double remaining = cluster.GetVMMemory(vm_id);
+    double seconds = 0, moved = 0;
+    MigrationCost_t cost = {};
+    while(cost.rounds < MIGRATION_MAX_ROUNDS && remaining > MIGRATION_STOP_COPY) {
+        double round = remaining / bandwidth;
+        double dirtied = min(double(cluster.GetVMMemory(vm_id)), dirty_rate * round);
+        seconds += round;
+        moved += remaining;
+        cost.rounds++;
+        if(dirtied >= remaining) {
+            // Dirtied as fast as it is copied, more rounds do not help
+            remaining = dirtied;
+            break;
+        }
+        remaining = dirtied;
+    }
+    double downtime = remaining / bandwidth;
+    cost.downtime = Time_t(downtime * 1e6);
+    cost.duration = Time_t((seconds + downtime) * 1e6);
+    cost.megabytes = uint64_t(moved + remaining);
+    return cost;
+}
+
+void MigrationModel::MigrationStarted(Time_t now, VMId_t vm_id) {
+    Migration_t migration;
+    migration.start = now;
+    migration.source = cluster.GetVMInfo(vm_id).machine_id;
+    migration.target = cluster.GetMigrationTarget(vm_id);
+    migration.cost = Estimate(vm_id, migration.target);
+    link_users[migration.source]++;
+    link_users[migration.target]++;
+    in_flight[vm_id] = migration;
+}
+
+void MigrationModel::MigrationComplete(Time_t now, VMId_t vm_id) {
+    auto it = in_flight.find(vm_id);
+    if(it == in_flight.end())
+        return;
+    const Migration_t & migration = it->second;
+    link_users[migration.source]--;
+    link_users[migration.target]--;
+    migrations++;
+    megabytes += migration.cost.megabytes;
+    modeled += migration.cost.duration;
+    simulated += now - migration.start;
+    SIM_OUTPUT("MigrationModel: VM " + to_string(vm_id) + " moved " + to_string(migration.cost.megabytes) + " MB in "
+               + to_string(migration.cost.rounds) + " rounds, modeled " + to_string(migration.cost.duration) + " us (downtime "
+               + to_string(migration.cost.downtime) + " us), simulated " + to_string(now - migration.start) + " us", 2);
+    in_flight.erase(it);
+}
+
+void MigrationModel::Report() const {
+    if(migrations == 0)
+        return;
+    SIM_OUTPUT("MigrationModel: " + to_string(migrations) + " migrations moved " + to_string(megabytes) + " MB, modeled "
+               + to_string(modeled / migrations) + " us and simulated " + to_string(simulated / migrations) + " us on average", 1);
+}
+
+// Timer ticks per transition, rows are the current state and columns the new one (Machine.o)
+static const unsigned transition_ticks[S_STATES][S_STATES] = {
+    {    0,    1,    1,   10,   25,   50,  250 },
+    {    1,    0,    5,   20,   20,   50,  150 },
+    {    5,    1,    0,   10,   20,   50,  150 },
+    {   50,   75,   20,    0,   20,   50,  150 },
+    {  100,   80,   50,   20,    0,   50,  150 },
+    {  200,  150,  100,  100,   50,    0,  150 },
+    { 5000, 4000, 3000, 3000, 3000, 3000,    0 }
+};
+
+void PowerPlanner::Init() {
+    plans.assign(cluster.GetTotal(), Plan_t{S0, 0, 0});
+}
+
+unsigned PowerPlanner::TransitionTicks(MachineState_t from, MachineState_t to) {
+    return transition_ticks[from][to];
+}
+
+Time_t PowerPlanner::IssueTime(MachineId_t machine_id, const Plan_t & plan) const {
+    // The last tick t with t + (ticks + 1) * TIMER_PERIOD > deadline, waiting for the next one would be late
+    Time_t lead = Time_t(TransitionTicks(cluster.GetState(machine_id), plan.s_state) + 1) * TIMER_PERIOD;
+    return plan.deadline >= lead ? plan.deadline - lead + 1 : 0;
+}
+
+void PowerPlanner::RequestState(Time_t now, MachineId_t machine_id, MachineState_t s_state, Time_t deadline) {
+    Plan_t & plan = plans[machine_id];
+    plan.s_state = s_state;
+    plan.deadline = deadline;
+    plan.sequence = ++sequence;
+    issues.push(Issue_t(max(now, IssueTime(machine_id, plan)), make_pair(plan.sequence, machine_id)));
+}
+
+void PowerPlanner::Cancel(MachineId_t machine_id) {
+    plans[machine_id].sequence = 0;
+}
+
+void PowerPlanner::Tick(Time_t now, vector<MachineId_t> & changed) {
+    while(!issues.empty() && issues.top().first <= now) {
+        uint64_t plan_sequence = issues.top().second.first;
+        MachineId_t machine_id = issues.top().second.second;
+        issues.pop();
+        Plan_t & plan = plans[machine_id];
+        if(plan.sequence != plan_sequence)
+            continue;
+        if(cluster.GetTargetState(machine_id) == plan.s_state) {
+            plan.sequence = 0;
+            continue;
+        }
+        if(cluster.GetState(machine_id) != cluster.GetTargetState(machine_id)) {
+            // Another change is in progress, its remaining ticks are not known
+            issues.push(Issue_t(now + TIMER_PERIOD, make_pair(plan_sequence, machine_id)));
+            continue;
+        }
+        Time_t issue = IssueTime(machine_id, plan);
+        if(issue > now) {
+            issues.push(Issue_t(issue, make_pair(plan_sequence, machine_id)));
+            continue;
+        }
+        cluster.SetState(machine_id, plan.s_state);
+        plan.sequence = 0;
+        changed.push_back(machine_id);
+    }
+}
+
+void VMPool::Init() {
+    by_machine.assign(size_t(cluster.GetTotal()) * VM_TYPES, vector<VMId_t>());
+    idle_on.assign(cluster.GetTotal(), 0);
+}
+
+VMId_t VMPool::Acquire(Time_t now, VMType_t vm_type, MachineId_t machine_id) {
+    VMId_t vm_id = Take(now, by_machine[machine_id * VM_TYPES + vm_type]);
+    if(vm_id != Cluster::NO_VM)
+        return vm_id;
+    vm_id = Boot(now, vm_type, machine_id);
+    cold++;
+    boot_wait += VM_BOOT_LATENCY;
+    return vm_id;
+}
+
+VMId_t VMPool::AcquireAny(Time_t now, VMType_t vm_type, CPUType_t cpu) {
+    return Take(now, by_key[cpu * VM_TYPES + vm_type]);
+}
+
+void VMPool::Release(VMId_t vm_id) {
+    const VMInfo_t & vm = cluster.GetVMInfo(vm_id);
+    if(!vm.active_tasks.empty())
+        ThrowException("VMPool::Release(): VM still has tasks ", vm_id);
+    if(vm.machine_id == Cluster::NO_MACHINE || cluster.IsMigrating(vm_id)
+       || by_machine[vm.machine_id * VM_TYPES + vm.vm_type].size() >= VM_POOL_MAX_IDLE) {
+        MachineId_t machine_id = vm.machine_id;
+        cluster.ShutdownVM(vm_id);
+        placement.UpdateVM(vm_id);
+        if(machine_id != Cluster::NO_MACHINE)
+            placement.UpdateMachine(machine_id);
+        return;
+    }
+    Add(vm_id);
+}
+
+void VMPool::Prewarm(Time_t now, MachineId_t machine_id, VMType_t vm_type, unsigned count) {
+    while(by_machine[machine_id * VM_TYPES + vm_type].size() < count)
+        Add(Boot(now, vm_type, machine_id));
+}
+
+void VMPool::Drain(MachineId_t machine_id) {
+    for(unsigned i = 0; i < VM_TYPES; i++) {
+        vector<VMId_t> & list = by_machine[machine_id * VM_TYPES + i];
+        while(!list.empty()) {
+            VMId_t vm_id = list.back();
+            bool idle_here = IsIdle(vm_id);
+            Remove(vm_id);
+            if(idle_here) {
+                cluster.ShutdownVM(vm_id);
+                placement.UpdateVM(vm_id);
+            }
+        }
+    }
+    placement.UpdateMachine(machine_id);
+}
+
+void VMPool::Evict(VMId_t vm_id) {
+    if(vm_id < entries.size() && entries[vm_id].machine_list != NOT_POOLED)
+        Remove(vm_id);
+}
+
+void VMPool::Report() const {
+    if(warm + cold == 0)
+        return;
+    SIM_OUTPUT("VMPool: " + to_string(warm) + " warm and " + to_string(cold) + " cold VM starts, modeled boot wait "
+               + to_string(boot_wait / (warm + cold)) + " us on average, at most " + to_string(peak_idle) + " idle VMs ("
+               + to_string(peak_idle * VM_MEMORY_OVERHEAD) + " MB)", 1);
+}
+
+VMId_t VMPool::Boot(Time_t now, VMType_t vm_type, MachineId_t machine_id) {
+    VMId_t vm_id = cluster.CreateVM(vm_type, cluster.GetMachineInfo(machine_id).cpu);
+    cluster.AttachVM(vm_id, machine_id);
+    // The VM overhead changes the free memory of every VM on the machine
+    placement.UpdateMachine(machine_id);
+    Track(vm_id);
+    ready[vm_id] = now + VM_BOOT_LATENCY;
+    return vm_id;
+}
+
+VMId_t VMPool::Take(Time_t now, vector<VMId_t> & list) {
+    while(!list.empty()) {
+        VMId_t vm_id = list.back();
+        // Tasks may have been added to it, or it may have been moved, outside the pool
+        bool idle_here = IsIdle(vm_id);
+        Remove(vm_id);
+        if(!idle_here)
+            continue;
+        warm++;
+        if(ready[vm_id] > now)
+            boot_wait += ready[vm_id] - now;
+        return vm_id;
+    }
+    return Cluster::NO_VM;
+}
+
+bool VMPool::IsIdle(VMId_t vm_id) const {
+    const VMInfo_t & vm = cluster.GetVMInfo(vm_id);
+    return vm.machine_id == entries[vm_id].machine_list / VM_TYPES && vm.active_tasks.empty() && !cluster.IsMigrating(vm_id);
+}
+
+void VMPool::Add(VMId_t vm_id) {
+    const VMInfo_t & vm = cluster.GetVMInfo(vm_id);
+    Track(vm_id);
+    Entry_t & entry = entries[vm_id];
+    if(entry.machine_list != NOT_POOLED)
+        return;
+    entry.machine_list = vm.machine_id * VM_TYPES + vm.vm_type;
+    entry.key_list = vm.cpu * VM_TYPES + vm.vm_type;
+    vector<VMId_t> & on_machine = by_machine[entry.machine_list];
+    vector<VMId_t> & of_key = by_key[entry.key_list];
+    entry.machine_pos = unsigned(on_machine.size());
+    on_machine.push_back(vm_id);
+    entry.key_pos = unsigned(of_key.size());
+    of_key.push_back(vm_id);
+    idle_on[vm.machine_id]++;
+    peak_idle = max(peak_idle, ++idle);
+}
+
+void VMPool::Track(VMId_t vm_id) {
+    // VMs created outside the pool are booted from its point of view
+    if(vm_id >= ready.size()) {
+        ready.resize(vm_id + 1, 0);
+        entries.resize(vm_id + 1, Entry_t{NOT_POOLED, 0, 0, 0});
+    }
+}
+
+void VMPool::Remove(VMId_t vm_id) {
+    Entry_t & entry = entries[vm_id];
+    vector<VMId_t> & on_machine = by_machine[entry.machine_list];
+    vector<VMId_t> & of_key = by_key[entry.key_list];
+    // Swap with the last entry of each list
+    entries[on_machine.back()].machine_pos = entry.machine_pos;
+    on_machine[entry.machine_pos] = on_machine.back();
+    on_machine.pop_back();
+    entries[of_key.back()].key_pos = entry.key_pos;
+    of_key[entry.key_pos] = of_key.back();
+    of_key.pop_back();
+    idle_on[entry.machine_list / VM_TYPES]--;
+    idle--;
+    entry.machine_list = NOT_POOLED;
+}
+
+void StarterPolicy::Init(Scheduler & scheduler) {
+    Cluster & cluster = scheduler.GetCluster();
     for(unsigned i = 0; i < active_machines; i++)
-        vms.push_back(VM_Create(LINUX, X86));
+        vms.push_back(cluster.CreateVM(LINUX, X86));
     for(unsigned i = 0; i < active_machines; i++) {
         machines.push_back(MachineId_t(i));
     }    
     for(unsigned i = 0; i < active_machines; i++) {
-        VM_Attach(vms[i], machines[i]);
+        cluster.AttachVM(vms[i], machines[i]);
     }
 
     bool dynamic = false;
     if(dynamic)
         for(unsigned i = 0; i<4 ; i++)
             for(unsigned j = 0; j < 8; j++)
-                Machine_SetCorePerformance(MachineId_t(0), j, P3);
+                cluster.SetCorePerformance(MachineId_t(0), j, P3);
     // Turn off the ARM machines
     for(unsigned i = 24; i < Machine_GetTotal(); i++)
-        Machine_SetState(MachineId_t(i), S5);
+        cluster.SetState(MachineId_t(i), S5);
 
-    SimOutput("Scheduler::Init(): VM ids are " + to_string(vms[0]) + " ahd " + to_string(vms[1]), 3);
+    SIM_OUTPUT("Scheduler::Init(): VM ids are " + to_string(vms[0]) + " ahd " + to_string(vms[1]), 3);
 }
 
-void Scheduler::MigrationComplete(Time_t time, VMId_t vm_id) {
-    // Update your data structure. The VM now can receive new tasks
-}
-
-void Scheduler::NewTask(Time_t now, TaskId_t task_id) {
+void StarterPolicy::NewTask(Scheduler & scheduler, Time_t now, TaskId_t task_id) {
     // Get the task parameters
-    //  IsGPUCapable(task_id);
-    //  GetMemory(task_id);
-    //  RequiredVMType(task_id);
-    //  RequiredSLA(task_id);
-    //  RequiredCPUType(task_id);
+    //  cluster.GetTaskPlacementKey(task_id) has the GPU flag, memory, VM type, SLA, CPU type and
+    //  target completion of the task in one read
     // Decide to attach the task to an existing VM, 
     //      vm.AddTask(taskid, Priority_T priority); or
     // Create a new VM, attach the VM to a machine
     //      VM vm(type of the VM)
     //      vm.Attach(machine_id);
     //      vm.AddTask(taskid, Priority_t priority) or
+    // Take a warm VM from the pool, created and attached if there is none, and pool.Release() it
+    // once its last task is complete
+    //      vm_id = pool.Acquire(now, vm_type, machine_id); or
     // Turn on a machine, create a new VM, attach it to the VM, then add the task
     //
     // Turn on a machine, migrate an existing VM from a loaded machine....
     //
     // Other possibilities as desired
     Priority_t priority = (task_id == 0 || task_id == 64)? HIGH_PRIORITY : MID_PRIORITY;
+    VMId_t vm_id;
     if(migrating) {
-        VM_AddTask(vms[0], task_id, priority);
+        vm_id = vms[0];
     }
     else {
-        VM_AddTask(vms[task_id % active_machines], task_id, priority);
+        vm_id = vms[task_id % active_machines];
     }// Skeleton code, you need to change it according to your algorithm
+    scheduler.AddTask(now, vm_id, task_id, priority);
 }
 
-void Scheduler::PeriodicCheck(Time_t now) {
-    // This method should be called from SchedulerCheck()
-    // SchedulerCheck is called periodically by the simulator to allow you to monitor, make decisions, adjustments, etc.
-    // Unlike the other invocations of the scheduler, this one doesn't report any specific event
-    // Recommendation: Take advantage of this function to do some monitoring and adjustments as necessary
+void StarterPolicy::PeriodicCheck(Scheduler & scheduler, Time_t now) {
+    checks++;
+    if(checks == 10) {
+        migrating = true;
+        scheduler.MigrateVM(now, 1, 9);
+    }
 }
 
-void Scheduler::Shutdown(Time_t time) {
-    // Do your final reporting and bookkeeping here.
-    // Report about the total energy consumed
-    // Report about the SLA compliance
-    // Shutdown everything to be tidy :-)
-    for(auto & vm: vms) {
-        VM_Shutdown(vm);
+void StarterPolicy::MigrationComplete(Scheduler & scheduler, Time_t now, VMId_t vm_id) {
+    migrating = false;
+}
+
+void StarterPolicy::Shutdown(Scheduler & scheduler, Time_t now) {
+    for(auto & vm: vms)
+        scheduler.ShutdownVM(vm);
+}
+
+void LeastLoadedPolicy::NewTask(Scheduler & scheduler, Time_t now, TaskId_t task_id) {
+    Cluster & cluster = scheduler.GetCluster();
+    const TaskPlacementKey_t & task = cluster.GetTaskPlacementKey(task_id);
+    CPUType_t cpu = CPUType_t(task.cpu);
+    VMType_t vm_type = VMType_t(task.vm_type);
+    unsigned memory = task.memory + VM_MEMORY_OVERHEAD;
+    MachineId_t machine_id = Cluster::NO_MACHINE;
+    if(task.gpu_capable)
+        machine_id = cluster.FindLeastLoaded(cpu, memory, true);
+    if(machine_id == Cluster::NO_MACHINE)
+        machine_id = cluster.FindLeastLoaded(cpu, memory, false);
+    // Nothing fits, overcommit the least loaded machine rather than drop the task
+    if(machine_id == Cluster::NO_MACHINE)
+        machine_id = cluster.FindLeastLoaded(cpu, 0, false);
+    if(machine_id == Cluster::NO_MACHINE)
+        ThrowException("LeastLoadedPolicy::NewTask(): No machine in S0 for task ", task_id);
+
+    // Share a busy VM of the type, idle ones are in the pool
+    VMId_t vm_id = Cluster::NO_VM;
+    for(VMId_t candidate : cluster.GetVMs(machine_id)) {
+        const VMInfo_t & vm = cluster.GetVMInfo(candidate);
+        if(vm.vm_type == vm_type && !vm.active_tasks.empty() && !cluster.IsMigrating(candidate)) {
+            vm_id = candidate;
+            break;
+        }
     }
-    SimOutput("SimulationComplete(): Finished!", 4);
-    SimOutput("SimulationComplete(): Time is " + to_string(time), 4);
+    if(vm_id == Cluster::NO_VM)
+        vm_id = scheduler.GetPool().Acquire(now, vm_type, machine_id);
+    Priority_t priority = task.sla == SLA0 ? HIGH_PRIORITY : task.sla == SLA1 ? MID_PRIORITY : LOW_PRIORITY;
+    scheduler.AddTask(now, vm_id, task_id, priority);
 }
 
-void Scheduler::TaskComplete(Time_t now, TaskId_t task_id) {
-    // Do any bookkeeping necessary for the data structures
-    // Decide if a machine is to be turned off, slowed down, or VMs to be migrated according to your policy
-    // This is an opportunity to make any adjustments to optimize performance/energy
-    SimOutput("Scheduler::TaskComplete(): Task " + to_string(task_id) + " is complete at " + to_string(now), 4);
+void LeastLoadedPolicy::TaskComplete(Scheduler & scheduler, Time_t now, TaskId_t task_id, VMId_t vm_id) {
+    Cluster & cluster = scheduler.GetCluster();
+    if(vm_id == Cluster::NO_VM || cluster.IsMigrating(vm_id) || !cluster.GetVMInfo(vm_id).active_tasks.empty())
+        return;
+    scheduler.GetPool().Release(vm_id);
 }
 
 // Public interface below
 
 static Scheduler Scheduler;
+static vector<TaskId_t> arrival_batch;
+static Time_t batch_start = 0;
+
+// Arrival times of the tasks still to arrive, filled while batching is on. Init.o creates the task
+// classes up front and the trace reads ahead of the clock, so the next arrival is always known.
+static priority_queue<Time_t, vector<Time_t>, greater<Time_t>> upcoming_arrivals;
+static TaskId_t calendar_end = 0;                           // The tasks below it have been added
+static bool calendar_open = false;
+
+// The policies compiled in, CLOUDSIM_POLICY selects one by name (default starter). Every callback
+// switches on the selection once and calls the Scheduler instantiated for that policy, so the
+// hooks are direct calls.
+static const char * policy_names[] = { "starter", "least-loaded" };
+static PolicyId_t selected_policy = POLICY_STARTER;
+static bool policy_started[sizeof(policy_names) / sizeof(policy_names[0])];
+static StarterPolicy starter_policy;
+static LeastLoadedPolicy least_loaded_policy;
+
+template<class Call>
+static inline void WithPolicy(Call call) {
+    switch(selected_policy) {
+        case POLICY_STARTER:
+            call(starter_policy);
+            break;
+        case POLICY_LEAST_LOADED:
+            call(least_loaded_policy);
+            break;
+    }
+}
+
+static void SelectPolicy() {
+    const char * name = getenv("CLOUDSIM_POLICY");
+    if(!name)
+        return;
+    for(unsigned i = 0; i < sizeof(policy_names) / sizeof(policy_names[0]); i++)
+        if(string(name) == policy_names[i]) {
+            selected_policy = PolicyId_t(i);
+            SIM_OUTPUT("InitScheduler(): Using the " + string(name) + " policy", 1);
+            return;
+        }
+    ThrowException("InitScheduler(): Unknown CLOUDSIM_POLICY ", name);
+}
+
+// Takes the arrival batching of the selected policy. Arrivals already buffered stay in the batch.
+static void ConfigureBatching() {
+    WithPolicy([](auto & policy) {
+        typedef typename remove_reference<decltype(policy)>::type P;
+        batch_arrivals = P::batch_arrivals;
+        batch_window = P::batch_window;
+    });
+    // CLOUDSIM_BATCH_WINDOW=us turns arrival batching on without a rebuild
+    const char * window = getenv("CLOUDSIM_BATCH_WINDOW");
+    if(window) {
+        batch_arrivals = true;
+        batch_window = strtoull(window, nullptr, 10);
+    }
+}
+
+// Delivers the buffered arrivals, if any. The batch is moved out first since placing it may call
+// back into the scheduler (MemoryWarning). Only call from HandleNewTask() and SchedulerCheck().
+static void FlushArrivals() {
+    if(arrival_batch.empty())
+        return;
+    vector<TaskId_t> batch;
+    batch.swap(arrival_batch);
+    HandleNewTasks(Now(), batch.data(), batch.size());
+}
+
+// Takes the arrival at time out of the calendar and returns the next one, Time_t(-1) when there is
+// none. The calendar opens on first use and leaves out the tasks that arrived before.
+static Time_t NextArrival(Time_t time) {
+    for(unsigned total = GetNumTasks(); calendar_end < total; calendar_end++) {
+        Time_t arrival = GetTaskInfo(calendar_end).arrival;
+        if(calendar_open || arrival > time)
+            upcoming_arrivals.push(arrival);
+    }
+    if(calendar_open && !upcoming_arrivals.empty())
+        upcoming_arrivals.pop();
+    calendar_open = true;
+    return upcoming_arrivals.empty() ? Time_t(-1) : upcoming_arrivals.top();
+}
 
 void InitScheduler() {
-    SimOutput("InitScheduler(): Initializing scheduler", 4);
-    Scheduler.Init();
+    Profile_Init();
+    Metrics_Init();
+    ProfileScope profile(PROFILE_INIT);
+    SIM_OUTPUT("InitScheduler(): Initializing scheduler", 4);
+    // Recorded tasks are replayed in addition to the task classes of the input file
+    const char * trace = getenv("CLOUDSIM_TRACE");
+    if(trace)
+        Trace_Open(trace, TRACE_LOOKAHEAD);
+    SelectPolicy();
+    ConfigureBatching();
+    policy_started[selected_policy] = true;
+    WithPolicy([](auto & policy) { Scheduler.Init(policy); });
+}
+
+PolicyId_t GetPolicy() {
+    return selected_policy;
+}
+
+void SwitchPolicy(PolicyId_t policy_id) {
+    selected_policy = policy_id;
+    ConfigureBatching();
+    if(policy_started[selected_policy])
+        return;
+    policy_started[selected_policy] = true;
+    WithPolicy([](auto & policy) { Scheduler.Adopt(policy); });
 }
 
 void HandleNewTask(Time_t time, TaskId_t task_id) {
-    SimOutput("HandleNewTask(): Received new task " + to_string(task_id) + " at time " + to_string(time), 4);
-    Scheduler.NewTask(time, task_id);
+    ProfileScope profile(PROFILE_NEW_TASK);
+    WhatIf_Check(time);
+    SIM_OUTPUT("HandleNewTask(): Received new task " + to_string(task_id) + " at time " + to_string(time), 4);
+    Trace_TaskArrived(time, task_id);
+    Scheduler.GetPacer().Activity();
+    Scheduler.GetSLAStats().TaskArrived(task_id);
+    if(!batch_arrivals) {
+        WithPolicy([&](auto & policy) { Scheduler.NewTask(policy, time, task_id); });
+        Scheduler.DeliverMemoryPressure(time);
+        return;
+    }
+    if(!arrival_batch.empty() && time > batch_start + batch_window)
+        FlushArrivals();
+    if(arrival_batch.empty())
+        batch_start = time;
+    arrival_batch.push_back(task_id);
+    if(NextArrival(time) > batch_start + batch_window)
+        FlushArrivals();
+}
+
+void HandleNewTasks(Time_t time, const TaskId_t * task_ids, size_t count) {
+    ProfileScope profile(PROFILE_NEW_TASKS);
+    SIM_OUTPUT("HandleNewTasks(): Received " + to_string(count) + " new tasks at time " + to_string(time), 4);
+    WithPolicy([&](auto & policy) { Scheduler.NewTasks(policy, time, task_ids, count); });
+    Scheduler.DeliverMemoryPressure(time);
 }
 
 void HandleTaskCompletion(Time_t time, TaskId_t task_id) {
-    SimOutput("HandleTaskCompletion(): Task " + to_string(task_id) + " completed at time " + to_string(time), 4);
-    Scheduler.TaskComplete(time, task_id);
+    ProfileScope profile(PROFILE_TASK_COMPLETION);
+    WhatIf_Check(time);
+    SIM_OUTPUT("HandleTaskCompletion(): Task " + to_string(task_id) + " completed at time " + to_string(time), 4);
+    Scheduler.GetPacer().Activity();
+    Scheduler.GetSLAStats().TaskCompleted(time, task_id);
+    WithPolicy([&](auto & policy) { Scheduler.TaskComplete(policy, time, task_id); });
+    Scheduler.DeliverMemoryPressure(time);
+}
+
+void MemoryPressure(Time_t time, MachineId_t machine_id, MemoryLevel_t level) {
+    ProfileScope profile(PROFILE_MEMORY_PRESSURE);
+    SIM_OUTPUT("MemoryPressure(): Machine " + to_string(machine_id) + " is at memory level " + to_string(level) + " at time " + to_string(time), 3);
+    WithPolicy([&](auto & policy) { Scheduler.MemoryPressure(policy, time, machine_id, level); });
 }
 
 void MemoryWarning(Time_t time, MachineId_t machine_id) {
+    ProfileScope profile(PROFILE_MEMORY_WARNING);
     // The simulator is alerting you that machine identified by machine_id is overcommitted
-    SimOutput("MemoryWarning(): Overflow at " + to_string(machine_id) + " was detected at time " + to_string(time), 0);
+    SIM_OUTPUT("MemoryWarning(): Overflow at " + to_string(machine_id) + " was detected at time " + to_string(time), 0);
 }
 
 void MigrationDone(Time_t time, VMId_t vm_id) {
+    ProfileScope profile(PROFILE_MIGRATION_DONE);
+    WhatIf_Check(time);
     // The function is called on to alert you that migration is complete
-    SimOutput("MigrationDone(): Migration of VM " + to_string(vm_id) + " was completed at time " + to_string(time), 4);
-    Scheduler.MigrationComplete(time, vm_id);
-    migrating = false;
+    SIM_OUTPUT("MigrationDone(): Migration of VM " + to_string(vm_id) + " was completed at time " + to_string(time), 4);
+    WithPolicy([&](auto & policy) { Scheduler.MigrationComplete(policy, time, vm_id); });
+    Scheduler.DeliverMemoryPressure(time);
 }
 
 void SchedulerCheck(Time_t time) {
+    ProfileScope profile(PROFILE_SCHEDULER_CHECK);
+    WhatIf_Check(time);
+    FlushArrivals();
     // This function is called periodically by the simulator, no specific event
-    SimOutput("SchedulerCheck(): SchedulerCheck() called at " + to_string(time), 4);
-    Scheduler.PeriodicCheck(time);
-    static unsigned counts = 0;
-    counts++;
-    if(counts == 10) {
-        migrating = true;
-        VM_Migrate(1, 9);
-    }
+    SIM_OUTPUT("SchedulerCheck(): SchedulerCheck() called at " + to_string(time), 4);
+    Scheduler.TimerTick(time);
+    if(Scheduler.GetPacer().Due(time))
+        WithPolicy([&](auto & policy) { Scheduler.PeriodicCheck(policy, time); });
+    Scheduler.DeliverMemoryPressure(time);
 }
 
 void SimulationComplete(Time_t time) {
+    ProfileScope profile(PROFILE_SIMULATION_COMPLETE);
+    WhatIf_Check(time, true);
     // This function is called before the simulation terminates Add whatever you feel like.
     cout << "SLA violation report" << endl;
     cout << "SLA0: " << GetSLAReport(SLA0) << "%" << endl;
@@ -150,16 +1433,28 @@ void SimulationComplete(Time_t time) {
     cout << "SLA2: " << GetSLAReport(SLA2) << "%" << endl;     // SLA3 do not have SLA violation issues
     cout << "Total Energy " << Machine_GetClusterEnergy() << "KW-Hour" << endl;
     cout << "Simulation run finished in " << double(time)/1000000 << " seconds" << endl;
-    SimOutput("SimulationComplete(): Simulation finished at time " + to_string(time), 4);
+    SIM_OUTPUT("SimulationComplete(): Simulation finished at time " + to_string(time), 4);
     
-    Scheduler.Shutdown(time);
+    WithPolicy([&](auto & policy) { Scheduler.Shutdown(policy, time); });
+    Metrics_Close();
+    Profile_Report(time);
+}
+
+void SLARisk(Time_t time, TaskId_t task_id) {
+    ProfileScope profile(PROFILE_SLA_RISK);
+    SIM_OUTPUT("SLARisk(): Task " + to_string(task_id) + " risks missing its SLA at time " + to_string(time), 4);
+    WithPolicy([&](auto & policy) { Scheduler.SLARisk(policy, time, task_id); });
 }
 
 void SLAWarning(Time_t time, TaskId_t task_id) {
-    
+    ProfileScope profile(PROFILE_SLA_WARNING);
 }
 
 void StateChangeComplete(Time_t time, MachineId_t machine_id) {
+    ProfileScope profile(PROFILE_STATE_CHANGE);
+    WhatIf_Check(time);
     // Called in response to an earlier request to change the state of a machine
+    WithPolicy([&](auto & policy) { Scheduler.StateChangeComplete(policy, time, machine_id); });
+    Scheduler.DeliverMemoryPressure(time);
 }
 
@@ -8,24 +8,569 @@
 #ifndef Scheduler_hpp
 #define Scheduler_hpp
 
+#include <cstdint>
+#include <queue>
+#include <set>
+#include <unordered_map>
 #include <vector>
 
 #include "Interfaces.h"
 
-class Scheduler {
+// The fields of a task that placement needs, packed in 24 bytes. GetTaskInfo() returns the whole
+// TaskInfo_t by value and every accessor such as GetTaskMemory() or RequiredSLA() validates the id
+// again, so the cluster reads each task once and serves the key from its own table.
+typedef struct {
+    Time_t target_completion;
+    unsigned memory;                        // Required memory in MB
+    uint8_t cpu;                            // CPUType_t
+    uint8_t vm_type;                        // VMType_t
+    uint8_t sla;                            // SLAType_t
+    uint8_t priority;                       // Priority_t the task arrived with
+    bool gpu_capable;
+} TaskPlacementKey_t;
+
+// Memory pressure of a machine, from the share of its memory in use (VM_MEMORY_OVERHEAD included).
+// The simulator only calls MemoryWarning() once a machine is overcommitted; the cluster tracks the
+// watermarks as it charges memory and reports every change of level through MemoryPressure().
+typedef enum {
+    MEMORY_NORMAL,
+    MEMORY_SOFT,                            // At least MEMORY_SOFT_PERCENT in use
+    MEMORY_HARD                             // At least MEMORY_HARD_PERCENT in use
+} MemoryLevel_t;
+#define MEMORY_SOFT_PERCENT 85
+#define MEMORY_HARD_PERCENT 95
+
+// Scheduler-side mirror of the machine and VM tables. Machine_GetInfo() and VM_GetInfo() return
+// their structures by value, copying the power/performance vectors and the task list on every call.
+// The cluster caches the descriptors once and keeps the fields that change up to date from the
+// scheduler's own actions, so lookups are references and the hot fields are plain loads.
+// All VM, task and power-state operations of the scheduler must go through the cluster to keep it
+// in sync. The energy_consumed field is only a snapshot from Init(), use Machine_GetEnergy().
+//
+// The fields that placement scans are also kept as a struct of arrays (one contiguous column per
+// field, indexed by machine id) so that the query helpers below are straight loops the compiler
+// can vectorize.
+class Cluster {
+public:
+    Cluster()                   {}
+    void Init();
+
+    // Read-only views
+    const MachineInfo_t & GetMachineInfo(MachineId_t machine_id) const  { return machine_info[machine_id]; }
+    const VMInfo_t & GetVMInfo(VMId_t vm_id) const                      { return vm_info[vm_id]; }
+    const vector<VMId_t> & GetVMs(MachineId_t machine_id) const         { return machine_vms[machine_id]; }
+    unsigned GetActiveTasks(MachineId_t machine_id) const               { return active_tasks[machine_id]; }
+    int GetMemoryFree(MachineId_t machine_id) const                     { return memory_free[machine_id]; }
+    MemoryLevel_t GetMemoryLevel(MachineId_t machine_id) const          { return MemoryLevel_t(memory_level[machine_id]); }
+    unsigned GetMemoryUsed(MachineId_t machine_id) const                { return machine_info[machine_id].memory_used; }
+    MachineState_t GetState(MachineId_t machine_id) const               { return MachineState_t(s_state[machine_id]); }
+    MachineState_t GetTargetState(MachineId_t machine_id) const         { return MachineState_t(target_state[machine_id]); }
+    unsigned GetTotal() const                                           { return unsigned(machine_info.size()); }
+    unsigned GetVMTotal() const                                         { return unsigned(vm_info.size()); }
+    MachineId_t GetMigrationTarget(VMId_t vm_id) const                  { return migration_target[vm_id]; }
+    bool IsMigrating(VMId_t vm_id) const                                { return migration_target[vm_id] != NO_MACHINE; }
+    bool IsReady(MachineId_t machine_id) const                          { return s_state[machine_id] == S0 && target_state[machine_id] == S0; }
+
+    // Reads the task from the simulator on first use
+    const TaskPlacementKey_t & GetTaskPlacementKey(TaskId_t task_id);
+    VMId_t GetTaskVM(TaskId_t task_id) const { return task_id < task_vm.size() ? task_vm[task_id] : NO_VM; }
+    unsigned GetVMMemory(VMId_t vm_id) const;                           // The memory of its tasks plus VM_MEMORY_OVERHEAD
+
+    // Placement queries over machines that are in S0 and not changing state, have the CPU type,
+    // a GPU if one is required, and at least memory MB free (so memory should include
+    // VM_MEMORY_OVERHEAD when a new VM has to be created).
+    // FilterMachines() fills out with the matching machine ids and returns their number.
+    // FindLeastLoaded() returns the match with the fewest active tasks, lowest id on ties,
+    // or NO_MACHINE when nothing fits.
+    unsigned FilterMachines(CPUType_t cpu_type, unsigned memory, bool gpu_required, vector<MachineId_t> & out) const;
+    MachineId_t FindLeastLoaded(CPUType_t cpu_type, unsigned memory, bool gpu_required) const;
+
+    // Operations, these forward to the simulator and update the mirror
+    void AddTask(VMId_t vm_id, TaskId_t task_id, Priority_t priority);
+    void AttachVM(VMId_t vm_id, MachineId_t machine_id);
+    VMId_t CreateVM(VMType_t vm_type, CPUType_t cpu);
+    void MigrateVM(VMId_t vm_id, MachineId_t machine_id);
+    void SetCorePerformance(MachineId_t machine_id, unsigned core_id, CPUPerformance_t p_state);
+    void SetState(MachineId_t machine_id, MachineState_t s_state);
+    void ShutdownVM(VMId_t vm_id);
+
+    // Moves the machines whose memory level changed since the last call to out
+    void TakeMemoryLevelChanges(vector<MachineId_t> & out);
+
+    // Notifications from the simulator
+    void MigrationComplete(VMId_t vm_id);
+    void StateChangeComplete(MachineId_t machine_id);
+    MachineId_t TaskComplete(TaskId_t task_id);         // Returns the machine the task ran on
+
+    static constexpr MachineId_t NO_MACHINE = MachineId_t(-1);
+    static constexpr VMId_t NO_VM = VMId_t(-1);
+private:
+    void ChargeMemory(MachineId_t machine_id, int memory);
+    void SyncMachine(MachineId_t machine_id);                           // Takes the memory and VM count the simulator reports
+    void ChargeTasks(MachineId_t machine_id, int tasks);
+    void DetachFromMachine(VMId_t vm_id, MachineId_t machine_id);
+    void LoadTask(TaskId_t task_id);
+    void Match(CPUType_t cpu_type, unsigned memory, bool gpu_required, uint8_t * mask) const;
+
+    vector<MachineInfo_t> machine_info;
+    vector<vector<VMId_t>> machine_vms;
+    vector<VMInfo_t> vm_info;
+    vector<MachineId_t> migration_target;
+
+    // Task table, indexed by task id
+    vector<TaskPlacementKey_t> task_key;
+    vector<uint8_t> task_loaded;
+    vector<VMId_t> task_vm;
+
+    // Placement columns
+    vector<int> memory_free;
+    vector<int> soft_free;                  // Free memory at or below which the level is MEMORY_SOFT
+    vector<int> hard_free;
+    vector<uint8_t> memory_level;
+    vector<uint8_t> level_queued;
+    vector<MachineId_t> level_changes;
+    vector<unsigned> active_tasks;
+    vector<uint8_t> s_state;
+    vector<uint8_t> target_state;
+    vector<uint8_t> p_state;
+    vector<uint8_t> cpu;
+    vector<uint8_t> gpu;
+    mutable vector<uint8_t> scratch;
+};
+
+typedef enum {
+    BEST_FIT,                   // VM whose machine has the least free memory that still fits
+    FIRST_FIT,                  // First VM that fits, in the order the VMs entered their bucket
+    WORST_FIT                   // VM whose machine has the most free memory
+} Fit_t;
+
+// Ordered index over the VMs that can take a task: attached, not migrating, and on a machine that
+// is in S0 and not changing state. VMs are bucketed by (CPU type, VM type, GPU on the machine) and
+// every bucket is ordered by the free memory of the machine, then by its number of active tasks,
+// so all three fits are O(log N) regardless of the number of machines. A VM keeps its first-fit
+// position while it is out of the index, e.g. migrating, and gives it up once it is shut down.
+// The index reads the cluster; call UpdateMachine()/UpdateVM() after anything that changes the
+// memory, load, state or placement of a machine or VM.
+class PlacementIndex {
+public:
+    PlacementIndex(const Cluster & cluster) : cluster(cluster) {}
+    void Init();
+
+    // Returns Cluster::NO_VM when no VM in the bucket has memory MB free on its machine
+    VMId_t Find(Fit_t fit, CPUType_t cpu, VMType_t vm_type, bool gpu, unsigned memory) const;
+    void UpdateMachine(MachineId_t machine_id);
+    void UpdateVM(VMId_t vm_id);
+private:
+    typedef struct {
+        int memory_free;
+        unsigned active_tasks;
+        VMId_t vm_id;
+    } Key_t;
+    struct KeyOrder {
+        bool operator()(const Key_t & a, const Key_t & b) const {
+            if(a.memory_free != b.memory_free) return a.memory_free < b.memory_free;
+            if(a.active_tasks != b.active_tasks) return a.active_tasks < b.active_tasks;
+            return a.vm_id < b.vm_id;
+        }
+    };
+    typedef struct {
+        set<Key_t, KeyOrder> by_memory;
+        unordered_map<VMId_t, unsigned> slot;   // First-fit position of every VM that was in the bucket
+        vector<VMId_t> slot_vm;                 // Cluster::NO_VM on a free slot
+        vector<unsigned> free_slots;            // Of VMs shut down, taken by the next VMs to enter
+        vector<int> max_free;                   // Max tree over the slots, leaves start at leaves
+        unsigned leaves;
+    } Bucket_t;
+    typedef struct {
+        bool indexed;
+        unsigned bucket;
+        Key_t key;
+    } Entry_t;
+
+    static unsigned BucketOf(CPUType_t cpu, VMType_t vm_type, bool gpu);
+    void SetSlot(Bucket_t & bucket, VMId_t vm_id, int memory_free);
+    void FreeSlot(Bucket_t & bucket, VMId_t vm_id);
+
+    const Cluster & cluster;
+    vector<Bucket_t> buckets;
+    vector<Entry_t> entries;
+};
+
+// Paces the periodic work of the scheduler. The simulator's timer fires every 60 ms while tasks are
+// running and cannot be moved or cancelled from here, so the pacer decides which ticks run
+// PeriodicCheck() instead. Request() asks for the next check at a given time and skips the ticks
+// before it. In adaptive mode a tick without arrivals or completions since the last check doubles
+// the number of ticks skipped, up to CHECK_BACKOFF_MAX, and the next arrival or completion resets it.
+#define CHECK_BACKOFF_MAX 16
+
+class CheckPacer {
 public:
-    Scheduler()                 {}
+    CheckPacer(bool adaptive) : adaptive(adaptive), activity(false), requested(false), backoff(1), skipped(0), next_check(0) {}
+    void Activity() { activity = true; }            // Call on every arrival and completion
+    bool Due(Time_t now);                           // Call on every tick, true when the check should run
+    void Request(Time_t when);
+private:
+    bool adaptive;
+    bool activity;
+    bool requested;
+    unsigned backoff;
+    unsigned skipped;
+    Time_t next_check;
+};
+
+// Running per-SLA counters. GetSLAReport() is kept up to date as tasks complete, but it only covers
+// completed tasks. The stats also count the tasks in flight and how many of them are already past
+// their target completion, which a feedback policy needs to see before those tasks complete.
+typedef struct {
+    unsigned completed;
+    unsigned violated;                      // Completed after the target completion
+    unsigned in_flight;
+    unsigned late;                          // In flight and already past the target completion
+} SLACounts_t;
+
+class SLAStats {
+public:
+    SLAStats(Cluster & cluster) : cluster(cluster), counts() {}
+    void TaskArrived(TaskId_t task_id);
+    void TaskCompleted(Time_t time, TaskId_t task_id);
+    const SLACounts_t & Get(SLAType_t sla, Time_t now);                 // Amortized O(log tasks)
+private:
+    typedef pair<Time_t, TaskId_t> Deadline_t;
+
+    Cluster & cluster;                      // The SLA and target completion come from its task table
+    SLACounts_t counts[NUM_SLAS];
+    vector<uint8_t> state;                  // Indexed by task id, SLA in the low bits plus the flags below
+    priority_queue<Deadline_t, vector<Deadline_t>, greater<Deadline_t>> deadlines;
+};
+
+// GPU devices of the machines with gpus set. The simulator runs a gpu_capable task on such a
+// machine GPU_SPEEDUP times faster (CPU::TaskRun), for any number of tasks at once and without
+// drawing extra power. The model adds what a real device has: GPU_SLOTS tasks at a time, in the
+// order they are placed, and a power draw of GPU_IDLE_POWER plus the share of GPU_ACTIVE_POWER of
+// the slots in use, integrated while the machine is in S0. Only tasks holding a slot count as
+// accelerated in Speedup(), so estimates made with it err towards the slower CPU. A freed slot goes
+// to a waiting gpu_capable task of the same machine. The energy is modeled only and not part of
+// Machine_GetClusterEnergy().
+#define GPU_SPEEDUP         20              // Machine.o
+#define GPU_SLOTS           4               // Tasks per device
+#define GPU_IDLE_POWER      25              // W
+#define GPU_ACTIVE_POWER    250             // W with every slot in use
+
+typedef enum {
+    GPU_OFF,                                // No device, or the machine is not in S0
+    GPU_IDLE,
+    GPU_ACTIVE
+} GPUState_t;
+
+class GPUModel {
+public:
+    GPUModel(Cluster & cluster) : cluster(cluster), grants(0), in_use(0), peak(0) {}
     void Init();
-    void MigrationComplete(Time_t time, VMId_t vm_id);
-    void NewTask(Time_t now, TaskId_t task_id);
-    void PeriodicCheck(Time_t now);
-    void Shutdown(Time_t now);
+    GPUState_t GetState(MachineId_t machine_id) const;
+    unsigned FreeSlots(MachineId_t machine_id) const        { return slots[machine_id] - used[machine_id]; }
+    unsigned Speedup(TaskId_t task_id) const;
+    uint64_t GetEnergy(Time_t now, MachineId_t machine_id) const;  // uJ
+    double GetClusterEnergy(Time_t now) const;                      // KW-Hour
+
+    // Call after the cluster has been updated
+    void TaskPlaced(Time_t now, TaskId_t task_id);
     void TaskComplete(Time_t now, TaskId_t task_id);
+    void UpdateVM(Time_t now, VMId_t vm_id);                // On migration start and completion
+    void StateChangeComplete(Time_t now, MachineId_t machine_id);
+    void Report(Time_t now) const;
+private:
+    void Fill(Time_t now, MachineId_t machine_id);
+    void Integrate(Time_t now, MachineId_t machine_id);
+    MachineId_t Release(Time_t now, TaskId_t task_id);      // Returns the machine of the slot, if any
+
+    Cluster & cluster;
+    vector<unsigned> slots;                 // Indexed by machine id
+    vector<unsigned> used;
+    vector<double> energy;                  // uJ up to last_update
+    vector<double> power;                   // W since last_update
+    vector<Time_t> last_update;
+    vector<MachineId_t> task_slot;          // Indexed by task id, the machine whose slot it holds
+    unsigned grants;                        // Slots handed out
+    unsigned in_use;                        // Slots in use over the cluster
+    unsigned peak;
+};
+
+// Deadline index over the in-flight SLA0-SLA2 tasks. The slack of a task is its target completion
+// minus its projected finish, from the remaining instructions and the MIPS of its machine at the
+// current P-state shared among the active tasks, times its GPUModel::Speedup(). Every task is kept
+// in a min-heap at the time its slack would reach the threshold if it made no progress, and is only
+// looked at again then, or after SLA_RISK_RECHECK us since the load of its machine may have changed.
+// Check() returns each task at most once.
+#define SLA_RISK_RECHECK 600000
+
+class SLARiskIndex {
+public:
+    SLARiskIndex(const Cluster & cluster, const GPUModel & gpus) : cluster(cluster), gpus(gpus), threshold(0) {}
+    void Init(Time_t threshold)             { this->threshold = threshold; }
+    void Add(Time_t now, TaskId_t task_id, const TaskPlacementKey_t & task);
+    void Remove(TaskId_t task_id);
+    void Check(Time_t now, vector<TaskId_t> & at_risk);     // Appends the tasks whose slack is below the threshold
+private:
+    typedef pair<Time_t, TaskId_t> Check_t;
+
+    const Cluster & cluster;
+    const GPUModel & gpus;
+    Time_t threshold;
+    vector<Time_t> target;                  // Indexed by task id
+    vector<uint8_t> tracked;                // Indexed by task id
+    priority_queue<Check_t, vector<Check_t>, greater<Check_t>> checks;
+};
+
+// Live-migration cost model. The simulator completes every migration a fixed 30 s after it starts,
+// whatever the size of the VM; the model estimates what a pre-copy migration would cost instead so
+// that consolidation policies can weigh it. The memory of the VM is copied over the links of the
+// source and target machines, each shared evenly among the migrations in flight on it. While a
+// round is copied the tasks of the VM dirty MIGRATION_DIRTY_RATE MB/s each, which the next round
+// copies again, until less than MIGRATION_STOP_COPY MB is left, the rounds stop shrinking, or
+// MIGRATION_MAX_ROUNDS is reached. The VM is then paused for the final copy (the downtime).
+// Bandwidth shares are taken when a migration starts and are not revised as others come and go.
+#define MIGRATION_BANDWIDTH     1250        // MB/s per machine link
+#define MIGRATION_DIRTY_RATE    16          // MB/s per active task of the VM
+#define MIGRATION_STOP_COPY     64          // MB
+#define MIGRATION_MAX_ROUNDS    30
+
+typedef struct {
+    Time_t duration;
+    Time_t downtime;
+    uint64_t megabytes;                     // Moved over the links, all rounds included
+    unsigned rounds;
+} MigrationCost_t;
+
+class MigrationModel {
+public:
+    MigrationModel(const Cluster & cluster) : cluster(cluster), migrations(0), megabytes(0), modeled(0), simulated(0) {}
+    void Init();
+    MigrationCost_t Estimate(VMId_t vm_id, MachineId_t target) const;   // The VM must be attached
+    void MigrationStarted(Time_t now, VMId_t vm_id);            // Call after Cluster::MigrateVM()
+    void MigrationComplete(Time_t now, VMId_t vm_id);           // Call before Cluster::MigrationComplete()
+    void Report() const;
+private:
+    typedef struct {
+        Time_t start;
+        MachineId_t source;
+        MachineId_t target;
+        MigrationCost_t cost;
+    } Migration_t;
+
+    const Cluster & cluster;
+    vector<unsigned> link_users;            // Migrations in flight per machine link
+    unordered_map<VMId_t, Migration_t> in_flight;
+    unsigned migrations;
+    uint64_t megabytes;
+    Time_t modeled;
+    Time_t simulated;
+};
+
+// Plans S-state changes that must be complete by a deadline, e.g. waking machines for a predicted
+// burst, and issues each one at the last timer tick that still meets it, so machines stay in
+// their low-power state as long as possible. The simulator counts a transition in timer ticks,
+// from the table in TransitionTicks(), and advances it on every tick, so a change issued on a tick
+// completes TransitionTicks() * TIMER_PERIOD later. Plans advance on the ticks too: like the
+// transitions themselves, they stall while the timer is stopped for lack of active tasks.
+#define TIMER_PERIOD 60000
+
+class PowerPlanner {
+public:
+    PowerPlanner(Cluster & cluster) : cluster(cluster), sequence(0) {}
+    void Init();
+    static unsigned TransitionTicks(MachineState_t from, MachineState_t to);
+    void RequestState(Time_t now, MachineId_t machine_id, MachineState_t s_state, Time_t deadline);    // Replaces an earlier plan
+    void Cancel(MachineId_t machine_id);
+    void Tick(Time_t now, vector<MachineId_t> & changed);      // Appends the machines whose state change was issued
+private:
+    typedef struct {
+        MachineState_t s_state;
+        Time_t deadline;
+        uint64_t sequence;                  // 0 when there is no plan
+    } Plan_t;
+    typedef pair<Time_t, pair<uint64_t, MachineId_t>> Issue_t;
+
+    Time_t IssueTime(MachineId_t machine_id, const Plan_t & plan) const;
+
+    Cluster & cluster;
+    vector<Plan_t> plans;                   // Indexed by machine id
+    priority_queue<Issue_t, vector<Issue_t>, greater<Issue_t>> issues;
+    uint64_t sequence;
+};
+
+// Warm VMs for reuse, so dynamic policies do not create and shut down a VM for every change of
+// load. The simulator has no way to detach a VM, so a pooled VM is idle but stays attached to its
+// machine and keeps holding VM_MEMORY_OVERHEAD there. The pool is keyed by (machine, VM type),
+// the machine fixing the CPU type, and by (CPU type, VM type) for AcquireAny(); both are O(1).
+// The simulator runs the tasks of a new VM right away; the pool models the VM_BOOT_LATENCY a cold
+// start would cost, so policies can weigh warm VMs against the memory they hold. A pooled VM that
+// received tasks, or was moved, through the cluster directly leaves the pool the next time it comes
+// up; Scheduler::MigrateVM() and ShutdownVM() take the VM out of the pool right away.
+// The pool keeps the placement index up to date with the VMs it creates and shuts down.
+#define VM_BOOT_LATENCY     5000000         // us
+#define VM_POOL_MAX_IDLE    2               // Warm VMs kept per machine and VM type on Release()
+
+class VMPool {
+public:
+    VMPool(Cluster & cluster, PlacementIndex & placement) : cluster(cluster), placement(placement), warm(0), cold(0), boot_wait(0), idle(0), peak_idle(0) {}
+    void Init();
+    VMId_t Acquire(Time_t now, VMType_t vm_type, MachineId_t machine_id);  // Creates and attaches one if none is warm
+    VMId_t AcquireAny(Time_t now, VMType_t vm_type, CPUType_t cpu);       // Cluster::NO_VM if none is warm
+    void Release(VMId_t vm_id);                                            // The VM must have no tasks
+    void Prewarm(Time_t now, MachineId_t machine_id, VMType_t vm_type, unsigned count);
+    void Drain(MachineId_t machine_id);     // Shuts down the warm VMs of the machine, e.g. before it sleeps
+    void Evict(VMId_t vm_id);               // Takes the VM out of the pool, if it is in
+    unsigned GetIdle(MachineId_t machine_id) const  { return idle_on[machine_id]; }
+    Time_t GetReadyTime(VMId_t vm_id) const         { return vm_id < ready.size() ? ready[vm_id] : 0; }   // Modeled end of its boot
+    void Report() const;
 private:
+    static constexpr unsigned VM_TYPES = AIX + 1;
+    static constexpr unsigned CPU_TYPES = X86 + 1;
+    static constexpr unsigned NOT_POOLED = unsigned(-1);
+
+    VMId_t Boot(Time_t now, VMType_t vm_type, MachineId_t machine_id);
+    VMId_t Take(Time_t now, vector<VMId_t> & list);
+    bool IsIdle(VMId_t vm_id) const;        // Still idle on the machine it was pooled on
+    void Add(VMId_t vm_id);
+    void Remove(VMId_t vm_id);
+    void Track(VMId_t vm_id);
+
+    Cluster & cluster;
+    PlacementIndex & placement;
+    vector<vector<VMId_t>> by_machine;      // Index machine_id * VM_TYPES + vm_type
+    vector<VMId_t> by_key[CPU_TYPES * VM_TYPES];   // Index cpu * VM_TYPES + vm_type
+    // Where each VM sits in the pool, by VM id. The lists are those of the machine and key it was
+    // pooled under: the VM may have been moved or shut down since
+    typedef struct {
+        unsigned machine_list;              // NOT_POOLED when out of the pool
+        unsigned machine_pos;
+        unsigned key_list;
+        unsigned key_pos;
+    } Entry_t;
+    vector<Entry_t> entries;
+    vector<Time_t> ready;
+    vector<unsigned> idle_on;               // Indexed by machine id
+    unsigned warm;                          // Acquisitions served from the pool
+    unsigned cold;
+    Time_t boot_wait;                       // Modeled, over all acquisitions
+    unsigned idle;
+    unsigned peak_idle;
+};
+
+class Scheduler;
+
+// Scheduling policies. A policy is a class handed to the Scheduler methods as a template parameter,
+// so every hook is resolved at compile time and inlined into the event handlers, without virtual
+// calls on the per-task path. The Scheduler does the bookkeeping around the hooks (SLA risk, GPU
+// slots, placement index) and a policy only decides, through the components and operations of the
+// Scheduler it is given. Policies derive from Policy<themselves>, which supplies every hook but
+// NewTask() they leave out. Several policies are compiled into the simulator and CLOUDSIM_POLICY
+// selects one by name at start-up, see the policy table in Scheduler.cpp.
+// The traits choose how the scheduler drives the policy; a policy redefines the ones it changes.
+template<class P>
+class Policy {
+public:
+    static constexpr bool adaptive_checks = false;  // Back off PeriodicCheck() while the cluster is idle, see CheckPacer
+    static constexpr bool batch_arrivals = false;   // Hand arrivals to NewTasks() in batches, see HandleNewTask()
+    static constexpr Time_t batch_window = 0;       // us after the first arrival of a batch, 0 batches equal timestamps only
+
+    void Init(Scheduler & scheduler)                                                            {}
+    void NewTasks(Scheduler & scheduler, Time_t now, const TaskId_t * task_ids, size_t count)   {
+        for(size_t i = 0; i < count; i++)
+            static_cast<P *>(this)->NewTask(scheduler, now, task_ids[i]);
+    }
+    void PeriodicCheck(Scheduler & scheduler, Time_t now)                                       {}
+    void TaskComplete(Scheduler & scheduler, Time_t now, TaskId_t task_id, VMId_t vm_id)        {}  // vm_id is the VM the task ran in
+    void MigrationComplete(Scheduler & scheduler, Time_t now, VMId_t vm_id)                     {}
+    void StateChangeComplete(Scheduler & scheduler, Time_t now, MachineId_t machine_id)         {}
+    void SLARisk(Scheduler & scheduler, Time_t now, TaskId_t task_id)                           {}
+    void MemoryPressure(Scheduler & scheduler, Time_t now, MachineId_t machine_id, MemoryLevel_t level) {}
+    void Shutdown(Scheduler & scheduler, Time_t now)                                            {}
+};
+
+class Scheduler {
+public:
+    Scheduler() : gpus(cluster), placement(cluster), risk(cluster, gpus), migrations(cluster), power(cluster), pool(cluster, placement), pacer(false), sla_stats(cluster) {}
+    template<class P> void Init(P & policy);
+    template<class P> void Adopt(P & policy);                  // Init() of a policy taking over
+    template<class P> void MigrationComplete(P & policy, Time_t time, VMId_t vm_id);
+    template<class P> void NewTask(P & policy, Time_t now, TaskId_t task_id);
+    template<class P> void NewTasks(P & policy, Time_t now, const TaskId_t * task_ids, size_t count);
+    template<class P> void PeriodicCheck(P & policy, Time_t now);
+    template<class P> void Shutdown(P & policy, Time_t now);
+    template<class P> void SLARisk(P & policy, Time_t now, TaskId_t task_id);
+    template<class P> void StateChangeComplete(P & policy, Time_t time, MachineId_t machine_id);
+    template<class P> void TaskComplete(P & policy, Time_t now, TaskId_t task_id);
+    template<class P> void MemoryPressure(P & policy, Time_t now, MachineId_t machine_id, MemoryLevel_t level);
+    void TimerTick(Time_t now);
+    void DeliverMemoryPressure(Time_t now);
+
+    // For the policies. The components are shared by all of them; the operations below forward
+    // to the cluster and keep the placement index and the models in sync with it
+    Cluster & GetCluster()                          { return cluster; }
+    const GPUModel & GetGPUs() const                { return gpus; }
+    const MigrationModel & GetMigrations() const    { return migrations; }
+    PlacementIndex & GetPlacement()                 { return placement; }
+    PowerPlanner & GetPower()                       { return power; }
+    VMPool & GetPool()                              { return pool; }
+    CheckPacer & GetPacer()                         { return pacer; }       // e.g. GetPacer().Request(time)
+    SLAStats & GetSLAStats()                        { return sla_stats; }   // e.g. GetSLAStats().Get(SLA0, now)
+    void AddTask(Time_t now, VMId_t vm_id, TaskId_t task_id, Priority_t priority);
+    void MigrateVM(Time_t now, VMId_t vm_id, MachineId_t machine_id);
+    void SetState(MachineId_t machine_id, MachineState_t s_state);
+    void ShutdownVM(VMId_t vm_id);
+private:
+    void SampleMetrics(Time_t now);
+
+    Cluster cluster;
+    GPUModel gpus;
+    PlacementIndex placement;
+    SLARiskIndex risk;
+    MigrationModel migrations;
+    PowerPlanner power;
+    VMPool pool;
+    CheckPacer pacer;
+    SLAStats sla_stats;                     // Live SLA counters of every task the simulator sent
+    vector<TaskId_t> at_risk;
+    vector<MachineId_t> changed;
+    vector<MachineId_t> pressure;
+};
+
+// The starter code: one LINUX VM on each of the first machines, tasks spread over them round-robin
+class StarterPolicy : public Policy<StarterPolicy> {
+public:
+    StarterPolicy() : migrating(false), checks(0) {}
+    void Init(Scheduler & scheduler);
+    void NewTask(Scheduler & scheduler, Time_t now, TaskId_t task_id);
+    void PeriodicCheck(Scheduler & scheduler, Time_t now);
+    void MigrationComplete(Scheduler & scheduler, Time_t now, VMId_t vm_id);
+    void Shutdown(Scheduler & scheduler, Time_t now);
+private:
+    bool migrating;
+    unsigned checks;
     vector<VMId_t> vms;
     vector<MachineId_t> machines;
 };
 
+// Every task goes to a VM of its type on the least loaded machine that fits it, from the VM pool
+// when the machine has none. VMs go back to the pool when their last task completes.
+class LeastLoadedPolicy : public Policy<LeastLoadedPolicy> {
+public:
+    void NewTask(Scheduler & scheduler, Time_t now, TaskId_t task_id);
+    void TaskComplete(Scheduler & scheduler, Time_t now, TaskId_t task_id, VMId_t vm_id);
+};
+
+// The policies compiled in, see WithPolicy() in Scheduler.cpp
+typedef enum {
+    POLICY_STARTER,
+    POLICY_LEAST_LOADED
+} PolicyId_t;
 
+// Called with the changes of memory level after every event, see MemoryLevel_t
+extern void             MemoryPressure(Time_t time, MachineId_t machine_id, MemoryLevel_t level);
+// The policy handling the callbacks. SwitchPolicy() hands the callbacks to another one from now on,
+// running its Init() the first time; it is meant for what-if forks, see WhatIf_Fork()
+extern PolicyId_t       GetPolicy();
+extern void             SwitchPolicy(PolicyId_t policy_id);
 
 #endif /* Scheduler_hpp */
@@ -0,0 +1,165 @@
+//
+//  Trace.cpp
+//  CloudSim
+//
+//  Replays recorded task traces on top of the task classes of the input file.
+//
+
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Interfaces.h"
+#include "Internal_Interfaces.h"
+#include "TraceFormat.hpp"
+
+// A trace is a text file with one task per line, sorted by arrival. Empty lines and lines starting
+// with '#' are ignored. The fields are separated by white space:
+//      arrival target instructions memory SLA VM CPU GPU class
+// arrival and target (the target completion) are absolute times in microseconds, memory is in MB and
+// the remaining fields use the keywords of Input.md: SLA0..SLA3, LINUX/LINUX_RT/WIN/AIX,
+// ARM/POWER/RISCV/X86, yes/no and AI/CRYPTO/HPC/STREAM/WEB.
+// A trace can also be converted once with traceconvert to the binary format of TraceFormat.hpp,
+// which is mapped into memory and read in place.
+//
+// The file is read incrementally: at most lookahead tasks are created ahead of the simulation clock
+// and every arrival of a trace task reads the next record, so memory does not grow with the trace.
+
+static ifstream trace_file;
+static string trace_name;
+static unsigned trace_lookahead = 0;
+static unsigned line_number = 0;                // Of a text trace, the record number of a binary one
+static streamoff trace_offset = 0;              // Start of the next line, tracked so that forks can reopen the file there
+static TaskId_t first_trace_task = 0;
+static unsigned pending_arrivals = 0;
+static Time_t last_arrival = 0;
+static bool trace_open = false;
+
+// A binary trace, mapped. A fork inherits the mapping, so it needs no reopening
+static const TraceRecord_t * binary_records = nullptr;
+static uint64_t binary_count = 0;
+static size_t binary_size = 0;
+
+// Where the last record came from, for the messages
+static string Position() {
+    return " in " + trace_name + (binary_records ? " at record " : " at line ") + to_string(line_number);
+}
+
+static void CreateTask(const TraceRecord_t & record) {
+    if(record.arrival < last_arrival)
+        ThrowException("Trace: Records out of arrival order" + Position());
+    last_arrival = record.arrival;
+    AddTask(record.instructions, record.arrival, record.target, VMType_t(record.vm_type), SLAType_t(record.sla),
+            CPUType_t(record.cpu), record.gpu != 0, record.memory, TaskClass_t(record.task_class));
+    pending_arrivals++;
+}
+
+static void CloseTrace() {
+    SIM_OUTPUT("Trace: Finished reading" + Position(), 1);
+    if(binary_records) {
+        munmap(const_cast<TraceRecord_t *>(binary_records), binary_size);
+        binary_records = nullptr;
+    }
+    else
+        trace_file.close();
+    trace_open = false;
+}
+
+// Reads the next record and creates its task. Returns false at the end of the trace.
+static bool ReadNextTask() {
+    if(binary_records) {
+        if(line_number < binary_count) {
+            const TraceRecord_t & record = binary_records[line_number++];
+            if(!TraceRecordValid(record))
+                ThrowException("Trace: Invalid record" + Position());
+            CreateTask(record);
+            return true;
+        }
+        CloseTrace();
+        return false;
+    }
+    string line;
+    while(getline(trace_file, line)) {
+        line_number++;
+        trace_offset += streamoff(line.size()) + 1;
+        TraceRecord_t record;
+        const char * error;
+        switch(TraceParseLine(line.c_str(), record, error)) {
+            case TRACE_LINE_EMPTY:
+                continue;
+            case TRACE_LINE_BAD:
+                ThrowException("Trace: " + string(error) + Position());
+                break;
+            case TRACE_LINE_RECORD:
+                CreateTask(record);
+                return true;
+        }
+    }
+    CloseTrace();
+    return false;
+}
+
+// Maps the trace if it is binary. Returns false for a text trace
+static bool MapBinaryTrace(const string & filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        ThrowException("Trace_Open(): Cannot open trace file ", filename);
+    TraceHeader_t header;
+    struct stat info;
+    if(fstat(fd, &info) != 0 || pread(fd, &header, sizeof(header), 0) != ssize_t(sizeof(header))
+       || memcmp(header.magic, TRACE_MAGIC, TRACE_MAGIC_SIZE) != 0) {
+        close(fd);
+        return false;
+    }
+    if(uint64_t(info.st_size) != sizeof(header) + header.count * sizeof(TraceRecord_t)) {
+        close(fd);
+        ThrowException("Trace_Open(): Truncated binary trace ", filename);
+    }
+    binary_size = size_t(info.st_size);
+    void * mapped = mmap(nullptr, binary_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED)
+        ThrowException("Trace_Open(): Cannot map trace file ", filename);
+    madvise(mapped, binary_size, MADV_SEQUENTIAL);
+    binary_records = reinterpret_cast<const TraceRecord_t *>(static_cast<const char *>(mapped) + sizeof(header));
+    binary_count = header.count;
+    return true;
+}
+
+void Trace_Open(string filename, unsigned lookahead) {
+    if(!MapBinaryTrace(filename)) {
+        trace_file.open(filename);
+        if(!trace_file.is_open())
+            ThrowException("Trace_Open(): Cannot open trace file ", filename);
+    }
+    trace_name = filename;
+    trace_lookahead = lookahead ? lookahead : 1;
+    first_trace_task = GetNumTasks();
+    trace_open = true;
+    SIM_OUTPUT("Trace_Open(): Replaying " + filename + " with a lookahead of " + to_string(trace_lookahead) + " tasks", 1);
+    while(pending_arrivals < trace_lookahead && ReadNextTask())
+        ;
+}
+
+void Trace_Reopen() {
+    // A forked process shares the file offset with its parent, so it gets its own descriptor. The
+    // position comes from trace_offset since asking the stream would move the shared offset.
+    if(!trace_open || binary_records)
+        return;
+    trace_file.close();
+    trace_file.open(trace_name);
+    if(!trace_file.is_open())
+        ThrowException("Trace_Reopen(): Cannot open trace file ", trace_name);
+    trace_file.seekg(trace_offset);
+}
+
+void Trace_TaskArrived(Time_t time, TaskId_t task_id) {
+    if(task_id < first_trace_task || pending_arrivals == 0)
+        return;
+    pending_arrivals--;
+    while(trace_open && pending_arrivals < trace_lookahead && ReadNextTask())
+        ;
+}
@@ -0,0 +1,63 @@
+//
+//  TraceConvert.cpp
+//  CloudSim
+//
+//  Converts a text task trace to the binary format of TraceFormat.hpp.
+//
+//  Usage: traceconvert trace.txt trace.bin
+//
+
+#include <cstdio>
+#include <fstream>
+
+#include "TraceFormat.hpp"
+
+static int Fail(const string & message) {
+    cerr << "traceconvert: " << message << endl;
+    return 1;
+}
+
+int main(int argc, char * argv[]) {
+    if(argc != 3)
+        return Fail("Usage: traceconvert trace.txt trace.bin");
+    ifstream input(argv[1]);
+    if(!input.is_open())
+        return Fail(string("Cannot open ") + argv[1]);
+    FILE * output = fopen(argv[2], "wb");
+    if(!output)
+        return Fail(string("Cannot create ") + argv[2]);
+
+    // The count is written once every record is in
+    TraceHeader_t header;
+    memcpy(header.magic, TRACE_MAGIC, TRACE_MAGIC_SIZE);
+    header.count = 0;
+    fwrite(&header, sizeof(header), 1, output);
+
+    string line;
+    unsigned line_number = 0;
+    Time_t last_arrival = 0;
+    while(getline(input, line)) {
+        line_number++;
+        TraceRecord_t record;
+        const char * error;
+        TraceLine_t kind = TraceParseLine(line.c_str(), record, error);
+        if(kind == TRACE_LINE_EMPTY)
+            continue;
+        if(kind == TRACE_LINE_BAD || record.arrival < last_arrival) {
+            fclose(output);
+            remove(argv[2]);
+            return Fail(string(kind == TRACE_LINE_BAD ? error : "Records out of arrival order") + " in " + argv[1] + " at line " + to_string(line_number));
+        }
+        last_arrival = record.arrival;
+        fwrite(&record, sizeof(record), 1, output);
+        header.count++;
+    }
+    fseek(output, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, output);
+    if(ferror(output) | fclose(output)) {
+        remove(argv[2]);
+        return Fail(string("Cannot write ") + argv[2]);
+    }
+    cout << "traceconvert: " << header.count << " tasks from " << argv[1] << " to " << argv[2] << endl;
+    return 0;
+}
@@ -0,0 +1,126 @@
+//
+//  TraceFormat.hpp
+//  CloudSim
+//
+//  Record layout and text parser shared by the trace reader and traceconvert.
+//
+
+#ifndef TraceFormat_hpp
+#define TraceFormat_hpp
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "SimTypes.h"
+
+// A binary trace is a TraceHeader_t followed by count TraceRecord_t, sorted by arrival, in the byte
+// order of the machine that wrote it. `traceconvert trace.txt trace.bin` writes one from a text
+// trace (see Trace.cpp for the format). Trace_Open() tells the formats apart by the magic and maps a
+// binary trace with mmap, so its records are read in place without any parsing.
+#define TRACE_MAGIC         "CSTRACE1"
+#define TRACE_MAGIC_SIZE    8
+
+typedef struct {
+    char magic[TRACE_MAGIC_SIZE];
+    uint64_t count;
+} TraceHeader_t;
+
+typedef struct {
+    Time_t arrival;
+    Time_t target;                          // Target completion
+    uint64_t instructions;
+    uint32_t memory;                        // MB
+    uint8_t sla;                            // SLAType_t
+    uint8_t vm_type;                        // VMType_t
+    uint8_t cpu;                            // CPUType_t
+    uint8_t gpu;                            // 0 or 1
+    uint8_t task_class;                     // TaskClass_t
+    uint8_t reserved[3];
+} TraceRecord_t;
+
+static_assert(sizeof(TraceHeader_t) == 16 && sizeof(TraceRecord_t) == 40, "The binary trace layout must not change");
+
+typedef enum {
+    TRACE_LINE_EMPTY,                       // Blank or a comment
+    TRACE_LINE_RECORD,
+    TRACE_LINE_BAD                          // error names what is wrong
+} TraceLine_t;
+
+// Keywords of a field, indexed by the value of its enum
+static const char * const TRACE_SLA_NAMES[]     = { "SLA0", "SLA1", "SLA2", "SLA3" };
+static const char * const TRACE_VM_NAMES[]      = { "LINUX", "LINUX_RT", "WIN", "AIX" };
+static const char * const TRACE_CPU_NAMES[]     = { "ARM", "POWER", "RISCV", "X86" };
+static const char * const TRACE_GPU_NAMES[]     = { "no", "yes" };
+static const char * const TRACE_CLASS_NAMES[]   = { "AI", "CRYPTO", "HPC", "STREAM", "WEB" };
+
+// Moves line past the white space and the next field and returns the field's length
+static inline size_t TraceField(const char * & line, const char * & field) {
+    while(*line == ' ' || *line == '\t' || *line == '\r' || *line == '\n')
+        line++;
+    field = line;
+    while(*line && *line != ' ' && *line != '\t' && *line != '\r' && *line != '\n')
+        line++;
+    return size_t(line - field);
+}
+
+template<size_t N>
+static inline bool TraceKeyword(const char * & line, const char * const (& names)[N], uint8_t & value) {
+    const char * field;
+    size_t length = TraceField(line, field);
+    for(size_t i = 0; i < N; i++)
+        if(strlen(names[i]) == length && memcmp(names[i], field, length) == 0) {
+            value = uint8_t(i);
+            return true;
+        }
+    return false;
+}
+
+static inline bool TraceNumber(const char * & line, uint64_t & value) {
+    const char * field;
+    size_t length = TraceField(line, field);
+    if(length == 0 || field[0] < '0' || field[0] > '9')
+        return false;
+    char * end;
+    value = strtoull(field, &end, 10);
+    return end == line;
+}
+
+// Parses one line of a text trace into record
+static inline TraceLine_t TraceParseLine(const char * line, TraceRecord_t & record, const char * & error) {
+    const char * field;
+    const char * rest = line;
+    if(TraceField(rest, field) == 0 || field[0] == '#')
+        return TRACE_LINE_EMPTY;
+    rest = line;
+    uint64_t memory;
+    memset(&record, 0, sizeof(record));
+    error = "Malformed record";
+    if(!TraceNumber(rest, record.arrival) || !TraceNumber(rest, record.target)
+       || !TraceNumber(rest, record.instructions) || !TraceNumber(rest, memory) || memory > UINT32_MAX)
+        return TRACE_LINE_BAD;
+    record.memory = uint32_t(memory);
+    error = "Unknown SLA type";
+    if(!TraceKeyword(rest, TRACE_SLA_NAMES, record.sla))
+        return TRACE_LINE_BAD;
+    error = "Unknown VM type";
+    if(!TraceKeyword(rest, TRACE_VM_NAMES, record.vm_type))
+        return TRACE_LINE_BAD;
+    error = "Unknown CPU type";
+    if(!TraceKeyword(rest, TRACE_CPU_NAMES, record.cpu))
+        return TRACE_LINE_BAD;
+    error = "Unknown GPU flag";
+    if(!TraceKeyword(rest, TRACE_GPU_NAMES, record.gpu))
+        return TRACE_LINE_BAD;
+    error = "Unknown task type";
+    if(!TraceKeyword(rest, TRACE_CLASS_NAMES, record.task_class))
+        return TRACE_LINE_BAD;
+    return TRACE_LINE_RECORD;
+}
+
+// Checks a record read from a binary trace, which has not been through TraceParseLine()
+static inline bool TraceRecordValid(const TraceRecord_t & record) {
+    return record.sla <= SLA3 && record.vm_type <= AIX && record.cpu <= X86 && record.gpu <= 1 && record.task_class <= WEB_REQUEST;
+}
+
+#endif /* TraceFormat_hpp */
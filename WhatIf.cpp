@@ -0,0 +1,132 @@
+//
+//  WhatIf.cpp
+//  CloudSim
+//
+//  Copy-on-write forks of the simulation for lookahead scheduling.
+//
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "Metrics.hpp"
+#include "WhatIf.hpp"
+
+// In a fork: where the result goes and when to send it
+static int result_pipe = -1;
+static Time_t horizon_end = 0;
+static WhatIfResult_t start_state;
+
+// In the process that forked: the read end of the pipe of every fork in flight
+static unordered_map<int, int> fork_pipes;
+
+static void Snapshot(Time_t time, WhatIfResult_t & state) {
+    state.start = state.end = time;
+    state.energy = Machine_GetClusterEnergy();
+    for(unsigned i = 0; i < NUM_SLAS; i++)
+        state.sla[i] = GetSLAReport(SLAType_t(i));
+}
+
+int WhatIf_Fork(Time_t now, Time_t horizon, PolicyId_t policy_id, const function<void()> & action) {
+    int fds[2];
+    if(pipe(fds) != 0)
+        return -1;
+    // Anything still buffered would be written by both processes
+    cout.flush();
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if(pid > 0) {
+        close(fds[1]);
+        fork_pipes[int(pid)] = fds[0];
+        return int(pid);
+    }
+
+    // The fork
+    close(fds[0]);
+    for(auto & pending : fork_pipes)
+        close(pending.second);
+    fork_pipes.clear();
+    int null = open("/dev/null", O_WRONLY);
+    if(null >= 0) {
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        close(null);
+    }
+    Trace_Reopen();
+    Metrics_Detach();
+    result_pipe = fds[1];
+    horizon_end = now + horizon;
+    Snapshot(now, start_state);
+    SwitchPolicy(policy_id);
+    action();
+    return 0;
+}
+
+bool WhatIf_Wait(int fork_id, WhatIfResult_t & result, unsigned timeout) {
+    auto it = fork_pipes.find(fork_id);
+    if(it == fork_pipes.end())
+        return false;
+    int fd = it->second;
+    fork_pipes.erase(it);
+
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout);
+    char * buffer = reinterpret_cast<char *>(&result);
+    size_t received = 0;
+    while(received < sizeof(result)) {
+        auto left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+        pollfd ready = { fd, POLLIN, 0 };
+        int polled = left > 0 ? poll(&ready, 1, int(left)) : 0;
+        if(polled < 0 && errno == EINTR)
+            continue;
+        if(polled <= 0) {
+            // Out of time: the fork will not get to finish
+            kill(pid_t(fork_id), SIGKILL);
+            break;
+        }
+        ssize_t count = read(fd, buffer + received, sizeof(result) - received);
+        if(count < 0 && errno == EINTR)
+            continue;
+        if(count <= 0)
+            break;
+        received += size_t(count);
+    }
+    close(fd);
+    int status;
+    while(waitpid(pid_t(fork_id), &status, 0) < 0 && errno == EINTR)
+        ;
+    return received == sizeof(result);
+}
+
+void WhatIf_Check(Time_t time, bool simulation_complete) {
+    if(result_pipe < 0 || (time < horizon_end && !simulation_complete))
+        return;
+    WhatIfResult_t result;
+    Snapshot(time, result);
+    result.start = start_state.start;
+    result.energy -= start_state.energy;
+    for(unsigned i = 0; i < NUM_SLAS; i++)
+        result.sla[i] -= start_state.sla[i];
+    const char * buffer = reinterpret_cast<const char *>(&result);
+    size_t sent = 0;
+    while(sent < sizeof(result)) {
+        ssize_t count = write(result_pipe, buffer + sent, sizeof(result) - sent);
+        if(count < 0 && errno == EINTR)
+            continue;
+        if(count <= 0)
+            break;
+        sent += size_t(count);
+    }
+    // Skip the atexit handlers and destructors of a simulation that is not ours to finish
+    _exit(0);
+}
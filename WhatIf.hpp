@@ -0,0 +1,47 @@
+//
+//  WhatIf.hpp
+//  CloudSim
+//
+//  Copy-on-write forks of the simulation for lookahead scheduling.
+//
+
+#ifndef WhatIf_hpp
+#define WhatIf_hpp
+
+#include <functional>
+
+#include "Interfaces.h"
+#include "Scheduler.hpp"
+
+// A what-if fork is a fork() of the simulator process, so the machine, VM, task and event state of
+// every module, prebuilt or not, is shared copy-on-write with the main simulation and nothing the
+// fork does is visible to it. The fork switches to the given policy (GetPolicy() to keep the
+// current one), applies the caller's action, e.g. a migration or S-state change, and then runs the
+// same event loop and scheduler forward. At the first callback at or after the horizon it sends its
+// result back and exits. Several forks run in parallel, one process each: start them all, then
+// wait for each one.
+//
+//      int fork_id = WhatIf_Fork(now, 10000000, GetPolicy(), [&]() { scheduler.MigrateVM(now, vm_id, machine_id); });
+//      if(fork_id == 0)
+//          return;                 // In the fork: leave the callback untouched from here on
+//      ...
+//      WhatIfResult_t outcome;
+//      if(WhatIf_Wait(fork_id, outcome)) ...
+//
+// Forks are silent, their output goes to /dev/null. A fork reaches its horizon on the first
+// scheduler callback after it, so end can be later than start + horizon, or earlier if the
+// simulation completes first. A fork that has not answered within timeout ms of wall-clock time,
+// e.g. one stuck in a long stretch without callbacks, is killed and WhatIf_Wait() returns false.
+#define WHATIF_WAIT_TIMEOUT 60000           // ms
+typedef struct {
+    Time_t start;
+    Time_t end;
+    double energy;                          // KW-Hour consumed by the cluster from start to end
+    double sla[NUM_SLAS];                   // Change of GetSLAReport() from start to end, in percentage points
+} WhatIfResult_t;
+
+extern int              WhatIf_Fork(Time_t now, Time_t horizon, PolicyId_t policy_id, const function<void()> & action); // Returns 0 in the fork, -1 on failure
+extern bool             WhatIf_Wait(int fork_id, WhatIfResult_t & result, unsigned timeout = WHATIF_WAIT_TIMEOUT); // False if the fork failed or timed out
+extern void             WhatIf_Check(Time_t time, bool simulation_complete = false);              // Call on every callback, ends a fork at its horizon
+
+#endif /* WhatIf_hpp */
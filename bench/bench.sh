@@ -0,0 +1,181 @@
+#!/bin/bash
+#
+#  bench.sh
+#  CloudSim
+#
+#  Engine throughput benchmarks over generated clusters of 100, 1k and 10k machines with a mix of
+#  AI, CRYPTO, HPC, STREAM and WEB task classes, plus a burst of short WEB requests. Each run is
+#  profiled through CLOUDSIM_PROFILE and reported as events per second, startup time and peak RSS,
+#  next to the numbers stored in bench/baseline.txt. Every benchmark runs several times and keeps its
+#  best numbers to filter out scheduling noise on the host. The placement and power decisions of the
+#  policy set the load on the engine (starter keeps every task on 16 machines and powers most of the
+#  rest off, least-loaded spreads the tasks over the whole cluster), so the baseline is kept per
+#  policy.
+#
+#  Usage: bench/bench.sh [-u] [-p "policy ..."] [-r runs] [-t percent] [-b simulator]
+#      -u  store the results as the new baseline of the policies that ran
+#      -p  policies to run the benchmarks with, passed as CLOUDSIM_POLICY (default: $CLOUDSIM_POLICY,
+#          or starter)
+#      -r  runs per benchmark (default 3)
+#      -t  slowdown or growth, in percent of the baseline, that counts as a regression (default 25)
+#      -b  simulator binary (default: ./simulator)
+#
+#  The exit status is 1 when any benchmark regressed.
+#
+
+dir=$(cd "$(dirname "$0")" && pwd)
+baseline="$dir/baseline.txt"
+update=0
+runs=3
+threshold=25
+simulator=./simulator
+policies=${CLOUDSIM_POLICY:-starter}
+
+while getopts "up:r:t:b:" opt; do
+    case $opt in
+        u) update=1 ;;
+        p) policies=$OPTARG ;;
+        r) runs=$OPTARG ;;
+        t) threshold=$OPTARG ;;
+        b) simulator=$OPTARG ;;
+        *) echo "Usage: $0 [-u] [-p \"policy ...\"] [-r runs] [-t percent] [-b simulator]" >&2; exit 1 ;;
+    esac
+done
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# machine_class count cpu cores gpu
+machine_class() {
+    cat <<CLASS
+machine class:
+{
+        Number of machines: $1
+        CPU type: $2
+        Number of cores: $3
+        Memory: 16384
+        S-States: [120, 100, 100, 80, 40, 10, 0]
+        P-States: [12, 8, 6, 4]
+        C-States: [12, 3, 1, 0]
+        MIPS: [1000, 800, 600, 400]
+        GPUs: $4
+}
+CLASS
+}
+
+# task_class type end inter_arrival runtime sla seed
+task_class() {
+    cat <<CLASS
+task class:
+{
+        Start time: 60000
+        End time : $2
+        Inter arrival: $3
+        Expected runtime: $4
+        Memory: 8
+        VM type: LINUX
+        GPU enabled: no
+        SLA type: $5
+        CPU type: X86
+        Task type: $1
+        Seed: $6
+}
+CLASS
+}
+
+# Half X86 with GPUs and half ARM without. The tasks are X86 so that every branch can place them.
+mixed() {
+    machine_class $(($1 / 2)) X86 8 yes
+    machine_class $(($1 / 2)) ARM 16 no
+    task_class WEB 2000000 2000 200000 SLA0 520230
+    task_class STREAM 2000000 20000 2000000 SLA1 520231
+    task_class AI 2000000 50000 5000000 SLA2 520232
+    task_class HPC 2000000 50000 8000000 SLA3 520233
+    task_class CRYPTO 2000000 5000 500000 SLA0 520234
+}
+
+burst() {
+    machine_class 100 X86 8 yes
+    task_class WEB 1000000 100 20000 SLA0 520235
+}
+
+mixed 100 > "$work/mixed-100.md"
+mixed 1000 > "$work/mixed-1k.md"
+mixed 10000 > "$work/mixed-10k.md"
+burst > "$work/web-burst.md"
+
+# json_value file key
+json_value() {
+    sed -n "s/^  \"$2\": \([0-9.e+-]*\),*$/\1/p" "$1"
+}
+
+# worse new old higher_is_better: prints the change in percent when it exceeds the threshold
+worse() {
+    awk -v new="$1" -v old="$2" -v up="$3" -v limit="$threshold" 'BEGIN {
+        if (old <= 0) exit
+        change = (new - old) * 100 / old
+        if ((up && change < -limit) || (!up && change > limit))
+            printf "%+.1f%%", change
+    }'
+}
+
+regressed=0
+: > "$work/results.txt"
+printf "%-14s %-12s %14s %14s %12s %12s %12s %12s  %s\n" "Policy" "Benchmark" "Events/s" "Baseline" "Startup ms" "Baseline" "RSS KB" "Baseline" "Status"
+for policy in $policies; do
+    for config in mixed-100 mixed-1k mixed-10k web-burst; do
+        events=""
+        for run in $(seq "$runs"); do
+            if ! CLOUDSIM_POLICY=$policy CLOUDSIM_PROFILE="$work/$config.json" "$simulator" "$work/$config.md" > "$work/$config.out" 2>&1; then
+                echo "$policy $config: simulator failed, see output below" >&2
+                tail -5 "$work/$config.out" >&2
+                events=""
+                break
+            fi
+            run_events=$(json_value "$work/$config.json" events_per_second)
+            run_startup=$(json_value "$work/$config.json" startup_ms)
+            run_rss=$(json_value "$work/$config.json" peak_rss_kb)
+            if [ -z "$events" ]; then
+                events=$run_events; startup=$run_startup; rss=$run_rss
+            else
+                events=$(awk -v a="$events" -v b="$run_events" 'BEGIN { print (b > a ? b : a) }')
+                startup=$(awk -v a="$startup" -v b="$run_startup" 'BEGIN { print (b < a ? b : a) }')
+                rss=$(awk -v a="$rss" -v b="$run_rss" 'BEGIN { print (b < a ? b : a) }')
+            fi
+        done
+        if [ -z "$events" ]; then
+            regressed=1
+            continue
+        fi
+        echo "$policy $config $events $startup $rss" >> "$work/results.txt"
+
+        read -r _ _ base_events base_startup base_rss < <(grep "^$policy $config " "$baseline" 2>/dev/null)
+        status="ok"
+        if [ -z "$base_events" ]; then
+            status="no baseline"
+        else
+            for check in "events/s $(worse "$events" "$base_events" 1)" "startup $(worse "$startup" "$base_startup" 0)" "RSS $(worse "$rss" "$base_rss" 0)"; do
+                set -- $check
+                if [ -n "$2" ]; then
+                    [ "$status" = "ok" ] && status="REGRESSION"
+                    status="$status $1 $2"
+                    regressed=1
+                fi
+            done
+        fi
+        printf "%-14s %-12s %14.0f %14.0f %12.1f %12.1f %12d %12d  %s\n" "$policy" "$config" "$events" "${base_events:-0}" "$startup" "${base_startup:-0}" "$rss" "${base_rss:-0}" "$status"
+    done
+done
+
+if [ $update -eq 1 ]; then
+    # The other policies keep their numbers
+    {
+        echo "# bench/bench.sh baseline: policy benchmark events_per_second startup_ms peak_rss_kb"
+        grep -v '^#' "$baseline" 2>/dev/null | awk -v ran="$policies" 'BEGIN { n = split(ran, p, " "); for(i = 1; i <= n; i++) skip[p[i]] = 1 } !($1 in skip)'
+        cat "$work/results.txt"
+    } > "$work/baseline.txt"
+    mv "$work/baseline.txt" "$baseline"
+    echo "Baseline written to $baseline"
+    exit 0
+fi
+exit $regressed
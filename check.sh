@@ -0,0 +1,110 @@
+#!/bin/bash
+#
+#  check.sh
+#  CloudSim
+#
+#  Regression runs of the simulator over Input.md and a generated task trace, with every policy and
+#  with arrival batching off and on. A run fails when the simulator exits with an error, does not
+#  finish within the time limit, or does not print its final report. Batching with a window of 0
+#  only groups equal arrival times and must report the same results as no batching, and so must
+#  the trace converted to the binary format by the traceconvert next to the simulator. Runs with a
+#  malformed trace must instead exit with an error, and within the time limit; an exit hang is
+#  intermittent, so they are repeated.
+#
+#  Usage: ./check.sh [-b simulator] [-t seconds]
+#      -b  simulator binary (default: ./simulator)
+#      -t  time limit per run (default 300)
+#
+#  The exit status is 1 when any run failed.
+#
+
+simulator=./simulator
+limit=300
+
+while getopts "b:t:" opt; do
+    case $opt in
+        b) simulator=$OPTARG ;;
+        t) limit=$OPTARG ;;
+        *) echo "Usage: $0 [-b simulator] [-t seconds]" >&2; exit 1 ;;
+    esac
+done
+
+dir=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# 2000 tasks on X86 over 10 s, arrivals bunched so that batches and completions interleave
+awk 'BEGIN {
+    srand(378)
+    slas[0] = "SLA0"; slas[1] = "SLA1"; slas[2] = "SLA2"; slas[3] = "SLA3"
+    arrival = 100000
+    for(i = 0; i < 2000; i++) {
+        arrival += (i % 8 == 0) ? int(rand() * 40000) : int(rand() * 3)
+        runtime = 200000 + int(rand() * 1000000)
+        printf "%d %d %d 8 %s LINUX X86 no WEB\n", arrival, arrival + 2 * runtime, runtime * 800, slas[i % 4]
+    }
+}' > "$work/trace.txt"
+
+failed=0
+run() {
+    local name=$1
+    shift
+    env "$@" timeout "$limit" "$simulator" "$dir/Input.md" > "$work/out.txt" 2>&1
+    local status=$?
+    if [ $status -ne 0 ] || ! grep -q "^Simulation run finished" "$work/out.txt"; then
+        echo "FAIL $name (exit $status)"
+        tail -3 "$work/out.txt" | sed 's/^/    /'
+        failed=1
+    else
+        echo "ok   $name"
+    fi
+}
+
+# Expects the report of the last run to equal the one saved as $1
+same_report() {
+    if cmp -s "$work/$1" "$work/out.txt"; then
+        echo "ok   $2"
+    else
+        echo "FAIL $2"
+        diff "$work/$1" "$work/out.txt" | head -6 | sed 's/^/    /'
+        failed=1
+    fi
+}
+
+# Expects the simulator to bail out, e.g. on a malformed trace
+run_error() {
+    local name=$1
+    shift
+    env "$@" timeout "$limit" "$simulator" "$dir/Input.md" > "$work/out.txt" 2>&1
+    local status=$?
+    if [ $status -eq 0 ] || [ $status -eq 124 ]; then
+        echo "FAIL $name (exit $status)"
+        failed=1
+    else
+        echo "ok   $name"
+    fi
+}
+
+if ! "$(dirname "$simulator")/traceconvert" "$work/trace.txt" "$work/trace.bin" > /dev/null; then
+    echo "FAIL traceconvert"
+    failed=1
+fi
+
+echo "1 2 3" > "$work/malformed.txt"
+for i in $(seq 10); do
+    run_error "malformed trace with metrics $i" CLOUDSIM_TRACE="$work/malformed.txt" CLOUDSIM_METRICS="$work/metrics"
+done
+
+for policy in starter least-loaded; do
+    run "$policy" CLOUDSIM_POLICY=$policy
+    run "$policy trace" CLOUDSIM_POLICY=$policy CLOUDSIM_TRACE="$work/trace.txt"
+    cp "$work/out.txt" "$work/unbatched.txt"
+    run "$policy binary trace" CLOUDSIM_POLICY=$policy CLOUDSIM_TRACE="$work/trace.bin"
+    same_report unbatched.txt "$policy binary trace matches text"
+    for window in 0 20000; do
+        run "$policy trace batch $window" CLOUDSIM_POLICY=$policy CLOUDSIM_TRACE="$work/trace.txt" CLOUDSIM_BATCH_WINDOW=$window
+        [ $window -eq 0 ] && same_report unbatched.txt "$policy trace batch 0 matches unbatched"
+    done
+done
+
+exit $failed
@@ -0,0 +1,81 @@
+#!/bin/bash
+#
+#  sweep.sh
+#  CloudSim
+#
+#  Runs the simulator over a set of input files and seeds in parallel and prints one merged table.
+#  Every run is its own simulator process, the simulator modules keep their state in globals.
+#
+#  Usage: ./sweep.sh [-j jobs] [-s "seed ..."] [-p "policy ..."] [-b simulator] input_file ...
+#      -j  number of simulations to run at once (default: number of CPUs)
+#      -s  seeds to substitute for the Seed of every task class; class i gets seed + i so that the
+#          classes keep independent arrival streams (default: the seeds in the input files)
+#      -p  scheduler policies to run every input with, passed as CLOUDSIM_POLICY (default: the
+#          simulator's default policy)
+#      -b  simulator binary (default: ./simulator)
+#
+
+jobs=$(nproc 2>/dev/null || echo 1)
+seeds=""
+policies=""
+simulator=./simulator
+
+while getopts "j:s:p:b:" opt; do
+    case $opt in
+        j) jobs=$OPTARG ;;
+        s) seeds=$OPTARG ;;
+        p) policies=$OPTARG ;;
+        b) simulator=$OPTARG ;;
+        *) echo "Usage: $0 [-j jobs] [-s \"seed ...\"] [-p \"policy ...\"] [-b simulator] input_file ..." >&2; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+if [ $# -eq 0 ]; then
+    echo "Usage: $0 [-j jobs] [-s \"seed ...\"] [-p \"policy ...\"] [-b simulator] input_file ..." >&2
+    exit 1
+fi
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# Build the run list, one "input seed policy" line per run ("-" keeps the input's own seeds or the
+# default policy)
+run=0
+for input in "$@"; do
+    if [ ! -r "$input" ]; then
+        echo "$0: cannot read $input" >&2
+        exit 1
+    fi
+    for seed in ${seeds:--}; do
+        for policy in ${policies:--}; do
+            if [ "$seed" = "-" ]; then
+                cp "$input" "$work/$run.md"
+            else
+                awk -v seed="$seed" '/Seed[ \t]*:/ { sub(/:.*/, ": " seed + class++) } { print }' "$input" > "$work/$run.md"
+            fi
+            echo "$input $seed $policy" > "$work/$run.name"
+            [ "$policy" = "-" ] || echo "$policy" > "$work/$run.policy"
+            run=$((run + 1))
+        done
+    done
+done
+
+seq 0 $((run - 1)) | xargs -P "$jobs" -I{} sh -c "[ -r \"$work/{}.policy\" ] && export CLOUDSIM_POLICY=\$(cat \"$work/{}.policy\"); \"$simulator\" \"$work/{}.md\" > \"$work/{}.out\" 2>&1"
+
+printf "%-32s %10s %-14s %9s %9s %9s %12s %10s\n" "Input" "Seed" "Policy" "SLA0 %" "SLA1 %" "SLA2 %" "KW-Hour" "Sim sec"
+for i in $(seq 0 $((run - 1))); do
+    read -r input seed policy < "$work/$i.name"
+    awk -v input="$input" -v seed="$seed" -v policy="$policy" '
+        /^SLA0:/ { sla0 = $2 }
+        /^SLA1:/ { sla1 = $2 }
+        /^SLA2:/ { sla2 = $2 }
+        /^Total Energy/ { energy = $3 }
+        /^Simulation run finished/ { seconds = $5 }
+        END {
+            sub(/%/, "", sla0); sub(/%/, "", sla1); sub(/%/, "", sla2); sub(/KW-Hour/, "", energy)
+            if (seconds == "")
+                printf "%-32s %10s %-14s %s\n", input, seed, policy, "FAILED"
+            else
+                printf "%-32s %10s %-14s %9s %9s %9s %12s %10s\n", input, seed, policy, sla0, sla1, sla2, energy, seconds
+        }' "$work/$i.out"
+done